@@ -1,4 +1,7 @@
-__all__=['merge_ptex', 'remerge_ptex', 'reverse_ptex',
-         'make_constant', 'ptex_info', 'ptex_conform']
-from cptexutils import merge_ptex, remerge_ptex, reverse_ptex, \
-    make_constant, ptex_info, ptex_conform
+__all__=['merge_ptex', 'merge_plan', 'merge_ptex_sharded', 'remerge_ptex',
+         'compact_ptex', 'split_ptex', 'reverse_ptex', 'make_constant',
+         'ptex_info', 'ptex_conform', 'pack_ptex', 'patch_ptex',
+         'MergedIndex']
+from cptexutils import merge_ptex, merge_plan, merge_ptex_sharded, \
+    remerge_ptex, compact_ptex, split_ptex, reverse_ptex, make_constant, \
+    ptex_info, ptex_conform, pack_ptex, patch_ptex, MergedIndex
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <PtexHalf.h>
+
+#include "convert.hpp"
+#include "helpers.hpp"
+
+template <Ptex::DataType DT> struct Traits;
+
+template <> struct Traits<Ptex::dt_uint8> {
+    typedef uint8_t type;
+    static float to_float(uint8_t v) { return float(v) * (1.f/255.f); }
+    static uint8_t from_float(float v) {
+        return uint8_t((v < 0.f ? 0.f : v > 1.f ? 1.f : v) * 255.f + 0.5f);
+    }
+};
+
+template <> struct Traits<Ptex::dt_uint16> {
+    typedef uint16_t type;
+    static float to_float(uint16_t v) { return float(v) * (1.f/65535.f); }
+    static uint16_t from_float(float v) {
+        return uint16_t((v < 0.f ? 0.f : v > 1.f ? 1.f : v) * 65535.f + 0.5f);
+    }
+};
+
+template <> struct Traits<Ptex::dt_half> {
+    typedef uint16_t type;
+    static float to_float(uint16_t v) { return PtexHalf::toFloat(v); }
+    static uint16_t from_float(float v) { return PtexHalf::fromFloat(v); }
+};
+
+template <> struct Traits<Ptex::dt_float> {
+    typedef float type;
+    static float to_float(float v) { return v; }
+    static float from_float(float v) { return v; }
+};
+
+template <Ptex::DataType S, Ptex::DataType D>
+struct Convert {
+    static typename Traits<D>::type apply(typename Traits<S>::type v) {
+        return Traits<D>::from_float(Traits<S>::to_float(v));
+    }
+};
+
+template <Ptex::DataType T>
+struct Convert<T, T> {
+    static typename Traits<T>::type apply(typename Traits<T>::type v) {
+        return v;
+    }
+};
+
+// N is compile time channel count, 0 for any. Inner loop has no
+// dependencies between elements so it is left to auto vectorizer.
+template <Ptex::DataType S, Ptex::DataType D, int N>
+static
+void convert_kernel(void *dst, const void *src, int src_nchannels,
+                    int nchannels, size_t npixels) {
+    typedef typename Traits<S>::type src_t;
+    typedef typename Traits<D>::type dst_t;
+    const int n = N ? N : nchannels;
+    const src_t *s = static_cast<const src_t*>(src);
+    dst_t *d = static_cast<dst_t*>(dst);
+    for (size_t p = 0; p < npixels; ++p, s += src_nchannels, d += n) {
+        for (int c = 0; c < n; ++c)
+            d[c] = Convert<S, D>::apply(s[c]);
+    }
+}
+
+typedef void (*kernel_t)(void*, const void*, int, int, size_t);
+
+template <Ptex::DataType S, Ptex::DataType D>
+static
+kernel_t select_kernel(int nchannels) {
+    switch (nchannels) {
+    case 1: return convert_kernel<S, D, 1>;
+    case 2: return convert_kernel<S, D, 2>;
+    case 3: return convert_kernel<S, D, 3>;
+    case 4: return convert_kernel<S, D, 4>;
+    default: return convert_kernel<S, D, 0>;
+    }
+}
+
+template <Ptex::DataType S>
+static
+kernel_t select_kernel(Ptex::DataType dst_dt, int nchannels) {
+    switch (dst_dt) {
+    case Ptex::dt_uint8: return select_kernel<S, Ptex::dt_uint8>(nchannels);
+    case Ptex::dt_uint16: return select_kernel<S, Ptex::dt_uint16>(nchannels);
+    case Ptex::dt_half: return select_kernel<S, Ptex::dt_half>(nchannels);
+    case Ptex::dt_float: return select_kernel<S, Ptex::dt_float>(nchannels);
+    }
+    return 0;
+}
+
+static
+kernel_t select_kernel(Ptex::DataType src_dt, Ptex::DataType dst_dt, int nchannels) {
+    switch (src_dt) {
+    case Ptex::dt_uint8: return select_kernel<Ptex::dt_uint8>(dst_dt, nchannels);
+    case Ptex::dt_uint16: return select_kernel<Ptex::dt_uint16>(dst_dt, nchannels);
+    case Ptex::dt_half: return select_kernel<Ptex::dt_half>(dst_dt, nchannels);
+    case Ptex::dt_float: return select_kernel<Ptex::dt_float>(dst_dt, nchannels);
+    }
+    return 0;
+}
+
+void convert_pixels(void *dst, Ptex::DataType dst_dt,
+                    const void *src, Ptex::DataType src_dt, int src_nchannels,
+                    int nchannels, size_t npixels) {
+    if (src_nchannels == nchannels) {
+        // No channels to skip, treat data as one channel image
+        if (src_dt == dst_dt) {
+            std::memcpy(dst, src, Ptex::DataSize(src_dt)*nchannels*npixels);
+            return;
+        }
+        npixels *= nchannels;
+        src_nchannels = nchannels = 1;
+    }
+    kernel_t kernel = select_kernel(src_dt, dst_dt, nchannels);
+    kernel(dst, src, src_nchannels, nchannels, npixels);
+}
+
+bool read_face_tiles(PtexTexture *ptex, int faceid, void *dst,
+                     Ptex::DataType dst_dt, int dst_nchannels,
+                     bool transpose) {
+    FaceDataPtr face(ptex->getData(faceid));
+    if (!face)
+        return false;
+    const Ptex::Res res = face->res();
+    const Ptex::DataType src_dt = ptex->dataType();
+    const int src_nchannels = ptex->numChannels();
+    const size_t src_pixel_size = Ptex::DataSize(src_dt) * src_nchannels;
+    const size_t dst_pixel_size = Ptex::DataSize(dst_dt) * dst_nchannels;
+    char *out = static_cast<char*>(dst);
+    std::vector<char> row;
+
+    // Copies block of bres texels at (u0, v0), block is tile or whole face
+    auto copy = [&](PtexFaceData *block, Ptex::Res bres, int u0, int v0) -> bool {
+        const char *src = static_cast<const char*>(block->getData());
+        if (!src)
+            return false;
+        const int bu = bres.u(), bv = bres.v();
+        row.resize(bu * dst_pixel_size);
+        const bool constant = block->isConstant();
+        if (constant) {
+            convert_pixels(row.data(), dst_dt, src, src_dt, src_nchannels, dst_nchannels, 1);
+            for (int u = 1; u < bu; ++u)
+                std::memcpy(row.data() + u*dst_pixel_size, row.data(), dst_pixel_size);
+        }
+        for (int v = 0; v < bv; ++v) {
+            if (!constant)
+                convert_pixels(row.data(), dst_dt, src + v*bu*src_pixel_size, src_dt,
+                               src_nchannels, dst_nchannels, bu);
+            if (!transpose) {
+                std::memcpy(out + ((v0 + v)*res.u() + u0)*dst_pixel_size, row.data(),
+                            bu*dst_pixel_size);
+                continue;
+            }
+            for (int u = 0; u < bu; ++u)
+                std::memcpy(out + ((u0 + u)*res.v() + v0 + v)*dst_pixel_size,
+                            row.data() + u*dst_pixel_size, dst_pixel_size);
+        }
+        return true;
+    };
+
+    if (!face->isTiled())
+        return copy(face.get(), res, 0, 0);
+    const Ptex::Res tres = face->tileRes();
+    const int ntilesu = res.ntilesu(tres), ntilesv = res.ntilesv(tres);
+    for (int tv = 0; tv < ntilesv; ++tv) {
+        for (int tu = 0; tu < ntilesu; ++tu) {
+            FaceDataPtr tile(face->getTile(tv*ntilesu + tu));
+            if (!tile || !copy(tile.get(), tres, tu*tres.u(), tv*tres.v()))
+                return false;
+        }
+    }
+    return true;
+}
+
+Ptex::Res conform_res(const Ptex::FaceInfo &face, int downsteps, int clamp_log)
+{
+    Ptex::Res res = face.res;
+    if (face.isConstant())
+        return res;
+    downsteps = std::max(0, downsteps);
+    clamp_log = clamp_log <= 0 ? 15 : clamp_log;
+    res.ulog2 = res.ulog2 > 2 ? std::max(1, res.ulog2 - downsteps) : res.ulog2;
+    res.vlog2 = res.vlog2 > 2 ? std::max(1, res.vlog2 - downsteps) : res.vlog2;
+    res.clamp(Ptex::Res(clamp_log, clamp_log));
+    return res;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <Ptexture.h>
+
+// Copies first nchannels of every src pixel to dst, converting from src_dt
+// to dst_dt in one pass. Gives same values as Ptex::ConvertToFloat
+// followed by Ptex::ConvertFromFloat.
+void convert_pixels(void *dst, Ptex::DataType dst_dt,
+                    const void *src, Ptex::DataType src_dt, int src_nchannels,
+                    int nchannels, size_t npixels);
+
+// Reads face at full resolution into dst, converting to dst_dt and first
+// dst_nchannels channels. With transpose texel (u, v) goes to row u and
+// column v. Tiles of reader are converted one at a time, so no face sized
+// buffer in input format is needed. Returns false if reader fails.
+bool read_face_tiles(PtexTexture *ptex, int faceid, void *dst,
+                     Ptex::DataType dst_dt, int dst_nchannels,
+                     bool transpose = false);
+
+// Resolution of face conformed by ptex_conform rules: sides above 4 texels
+// are reduced by downsteps log2 steps, down to 2 texels, then clamped to
+// 2^clamp_log. Zero clamp_log does not clamp. Constant faces keep res.
+Ptex::Res conform_res(const Ptex::FaceInfo &face, int downsteps, int clamp_log);
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "digest.hpp"
+
+static const uint64_t P1 = 11400714785074694791ULL;
+static const uint64_t P2 = 14029467366897019727ULL;
+static const uint64_t P3 = 1609587929392839161ULL;
+static const uint64_t P4 = 9650029242287828579ULL;
+static const uint64_t P5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * P1 + P4;
+}
+
+Digest::Digest(uint64_t seed) : _seed(seed) {
+    _acc[0] = seed + P1 + P2;
+    _acc[1] = seed + P2;
+    _acc[2] = seed;
+    _acc[3] = seed - P1;
+}
+
+void Digest::update(const void *data, size_t size) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + size;
+    _total += size;
+
+    if (_tail_size + size < 32) {
+        std::memcpy(_tail + _tail_size, p, size);
+        _tail_size += size;
+        return;
+    }
+    if (_tail_size) {
+        size_t fill = 32 - _tail_size;
+        std::memcpy(_tail + _tail_size, p, fill);
+        for (int i = 0; i < 4; ++i)
+            _acc[i] = xxh_round(_acc[i], read64(_tail + i*8));
+        p += fill;
+        _tail_size = 0;
+    }
+    uint64_t a0 = _acc[0], a1 = _acc[1], a2 = _acc[2], a3 = _acc[3];
+    for (; p + 32 <= end; p += 32) {
+        a0 = xxh_round(a0, read64(p));
+        a1 = xxh_round(a1, read64(p + 8));
+        a2 = xxh_round(a2, read64(p + 16));
+        a3 = xxh_round(a3, read64(p + 24));
+    }
+    _acc[0] = a0; _acc[1] = a1; _acc[2] = a2; _acc[3] = a3;
+    _tail_size = end - p;
+    std::memcpy(_tail, p, _tail_size);
+}
+
+uint64_t Digest::value() const {
+    uint64_t h;
+    if (_total >= 32) {
+        h = rotl(_acc[0], 1) + rotl(_acc[1], 7) + rotl(_acc[2], 12) + rotl(_acc[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = merge_round(h, _acc[i]);
+    }
+    else {
+        h = _seed + P5;
+    }
+    h += _total;
+
+    const unsigned char *p = _tail;
+    const unsigned char *end = _tail + _tail_size;
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h ^= uint64_t(read32(p)) * P1;
+        h = rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (*p) * P5;
+        h = rotl(h, 11) * P1;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool file_digest(const char *path, uint64_t &digest) {
+    FILE *f = std::fopen(path, "rb");
+    if (!f)
+        return false;
+    Digest d;
+    std::vector<char> buffer(1 << 20);
+    size_t n;
+    while ((n = std::fread(buffer.data(), 1, buffer.size(), f)) > 0)
+        d.update(buffer.data(), n);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    digest = d.value();
+    return ok;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64 bit XXH64 digest of data fed in pieces of any size
+class Digest {
+public:
+    explicit Digest(uint64_t seed = 0);
+    void update(const void *data, size_t size);
+    uint64_t value() const;
+
+private:
+    uint64_t _acc[4];
+    uint64_t _seed;
+    uint64_t _total = 0;
+    unsigned char _tail[32];
+    size_t _tail_size = 0;
+};
+
+// Digest of file contents, returns false if file can't be read
+bool file_digest(const char *path, uint64_t &digest);
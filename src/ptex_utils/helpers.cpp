@@ -1,7 +1,12 @@
 #include <cstring>
 
+#include <boost/filesystem.hpp>
+
 #include "helpers.hpp"
 
+namespace fs = boost::filesystem;
+namespace sys = boost::system;
+
 std::string strbasename(const char* s)
 {
     if (!s || !*s)
@@ -14,3 +19,66 @@ std::string strbasename(const char* s)
 
     return std::string(s+i, end-i);
 }
+
+void split_names(const char* str, std::vector<std::string> &names) {
+    const char* end;
+    end = std::strchr(str, ':');
+    while (str[0] && end) {
+        names.emplace_back(str, end-str);
+        str = end+1;
+        end = std::strchr(str, ':');
+    }
+    if (str[0])
+        names.push_back(str);
+}
+
+void write_uint64_meta(PtexWriter *writer, const char *key,
+                       const std::vector<uint64_t> &values) {
+    std::vector<int32_t> halves;
+    for (uint64_t v : values) {
+        halves.push_back(int32_t(uint32_t(v)));
+        halves.push_back(int32_t(uint32_t(v >> 32)));
+    }
+    writer->writeMeta(key, halves.data(), halves.size());
+}
+
+bool read_uint64_meta(PtexMetaData *meta, const char *key,
+                      std::vector<uint64_t> &values) {
+    const int32_t *halves = 0;
+    int nhalves = 0;
+    meta->getValue(key, halves, nhalves);
+    if (!halves || nhalves % 2)
+        return false;
+    values.resize(nhalves / 2);
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = uint64_t(uint32_t(halves[2*i])) | uint64_t(uint32_t(halves[2*i+1])) << 32;
+    return true;
+}
+
+int read_edit_state(PtexTexture *ptex, EditState &state, Ptex::String &err_msg) {
+    sys::error_code ec;
+    double size = fs::file_size(ptex->path(), ec);
+    if (ec) {
+        err_msg = ec.message().c_str();
+        return -1;
+    }
+    state = EditState();
+    state.size = state.base_size = size;
+    if (!ptex->hasEdits())
+        return 0;
+    MetaPtr meta(ptex->getMetaData());
+    const int32_t *count = 0;
+    const double *base_size = 0;
+    int n = 0;
+    meta->getValue("PtexRemergeEdits", count, n);
+    state.count = count && n == 1 ? count[0] : 1;
+    meta->getValue("PtexRemergeBaseSize", base_size, n);
+    if (base_size && n == 1 && base_size[0] <= size)
+        state.base_size = base_size[0];
+    return 0;
+}
+
+void write_edit_state(PtexWriter *writer, int32_t count, double base_size) {
+    writer->writeMeta("PtexRemergeEdits", &count, 1);
+    writer->writeMeta("PtexRemergeBaseSize", &base_size, 1);
+}
@@ -2,11 +2,38 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <Ptexture.h>
 
 std::string strbasename(const char* s);
 
+// Splits ':' separated file names of merge meta
+void split_names(const char* str, std::vector<std::string> &names);
+
+// 64 bit values are kept in int32 meta as low and high halves
+void write_uint64_meta(PtexWriter *writer, const char *key,
+                       const std::vector<uint64_t> &values);
+
+// Returns false if meta has no such key
+bool read_uint64_meta(PtexMetaData *meta, const char *key,
+                      std::vector<uint64_t> &values);
+
+// Incremental edits since file was last written whole are counted in
+// PtexRemergeEdits meta and PtexRemergeBaseSize keeps file size before
+// first of them. Meta is stale once file has no edits, reader folds them
+// then.
+struct EditState {
+    int32_t count = 0;
+    double base_size = 0;
+    double size = 0;
+};
+
+// Reads edit state of texture, size is taken from its file
+int read_edit_state(PtexTexture *ptex, EditState &state, Ptex::String &err_msg);
+
+void write_edit_state(PtexWriter *writer, int32_t count, double base_size);
+
 template <typename T>
 struct releaser {
     void operator()(T *r) const {
@@ -17,3 +44,4 @@ struct releaser {
 using MetaPtr = std::unique_ptr<PtexMetaData, releaser<PtexMetaData> >;
 using PtxPtr = std::unique_ptr<PtexTexture, releaser<PtexTexture> >;
 using WriterPtr = std::unique_ptr<PtexWriter, releaser<PtexWriter> >;
+using FaceDataPtr = std::unique_ptr<PtexFaceData, releaser<PtexFaceData> >;
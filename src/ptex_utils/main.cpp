@@ -4,6 +4,8 @@
 #include <cmath>
 #include <string.h>
 #include <limits>
+#include <algorithm>
+#include <vector>
 
 #define BOOST_NO_CXX11_SCOPED_ENUMS //TODO switch to new boost
 #include <boost/filesystem.hpp>
@@ -64,6 +66,31 @@ struct OptParse {
     }
 };
 
+int ipow(int base, int exp)
+{
+    int result = 1;
+    while (exp)
+    {
+        if (exp & 1)
+            result *= base;
+        exp >>= 1;
+        base *= base;
+    }
+    return result;
+}
+
+bool to_log2(int input, int8_t &outp) {
+    if (input < 2 || input > 32768)
+        return false;
+    int inp = input;
+    int8_t log2 = 0;
+    while (inp >>= 1) ++log2;
+    if (ipow(2, log2) != input)
+        return false;
+    outp = log2;
+    return true;
+}
+
 void merge_usage(const char* cprog) {
     std::string prog = strbasename(cprog);
     std::cerr
@@ -80,7 +107,38 @@ void merge_usage(const char* cprog) {
         <<"  -n N\n"
         <<"  --channels N        Number of channels. Default 1\n\n"
         <<"  -a N\n"
-        <<"  --alphachannel N    Alpha channel. Default -1\n\n";
+        <<"  --alphachannel N    Alpha channel. Default -1\n\n"
+        <<"  -j N\n"
+        <<"  --threads N         Number of threads decoding input faces,\n"
+        <<"                      0 to use all cores. Default 1\n\n"
+        <<"  -d N\n"
+        <<"  --downsize N        Downsize faces of inputs by N power of two steps\n"
+        <<"                      like conform does\n\n"
+        <<"  -c N\n"
+        <<"  --clampsize N       Clamp face resolution of inputs to N\n\n"
+        <<"  --max-open N        Stream inputs keeping at most N files open\n\n"
+        <<"  --max-memory MB     Bound memory used for face buffers, memory\n"
+        <<"                      of open input readers is not counted\n\n"
+        <<"  --stats             Print number of texels merged per second\n\n"
+        <<"  --skip-mipmaps      Skip mip maps when inputs are already in\n"
+        <<"                      output format. Reductions of inputs are not\n"
+        <<"                      kept, readers rebuild them on every\n"
+        <<"                      filtered lookup\n\n"
+        <<"  --virtual           Write only index of inputs, faces are read\n"
+        <<"                      from inputs by ptex_open\n\n"
+        <<"  --no-flatten        Record merged inputs themselves, not files\n"
+        <<"                      they were merged from\n\n"
+        <<"  --digests           Store content digests of sources, remerge\n"
+        <<"                      then updates only sources with changed\n"
+        <<"                      content. Reads every source once more\n\n"
+        <<"  --shard-faces N\n"
+        <<"  --shard-texels N\n"
+        <<"  --shard-mb N        Split output into output.0.ptx, output.1.ptx ..\n"
+        <<"                      keeping number of faces, texels or megabytes\n"
+        <<"                      of texel data in each under limit. Shard and\n"
+        <<"                      offset of inputs are written to output.manifest\n\n"
+        <<"  --plan              Do not merge, only print offsets and estimates\n"
+        <<"                      read from input headers. Output file is not given\n\n";
 
 }
 
@@ -92,12 +150,16 @@ int do_ptex_merge(int argc, const char** argv) {
     }
 
     bool do_guess = true;
+    bool do_plan = false;
+    bool do_shard = false;
+    PtexShardBudget budget;
     PtexMergeOptions o;
+    PtexMergeStats stats;
     OptParse opts(argc-2, argv+2);
     while(!opts.is_done() && opts.is_flag() ) {
-        do_guess = false;
         std::string opt(opts.get_opt());
         if (opt == "-t" || opt == "--datatype") {
+            do_guess = false;
             if (!opts.next_opt()) {
                 merge_usage(argv[0]);
                 return -1;
@@ -117,6 +179,7 @@ int do_ptex_merge(int argc, const char** argv) {
             }
         }
         else if(opt == "-n" || opt == "--channels") {
+            do_guess = false;
             int n = 0;
             if (!opts.next_opt() || !opts.int_opt(&n) || n <= 0) {
                 std::cerr<<"Invalid number of channels\n";
@@ -125,11 +188,79 @@ int do_ptex_merge(int argc, const char** argv) {
             o.num_channels = n;
         }
         else if (opt == "-a" || opt == "--alphachannel") {
+            do_guess = false;
             if (!opts.next_opt() || !opts.int_opt(&o.alpha_channel) || o.alpha_channel < -1) {
                 std::cerr<<"Invalid alpha channel\n";
                 return -1;
             }
         }
+        else if (opt == "-j" || opt == "--threads") {
+            if (!opts.next_opt() || !opts.int_opt(&o.num_threads) || o.num_threads < 0) {
+                std::cerr<<"Invalid number of threads\n";
+                return -1;
+            }
+        }
+        else if (opt == "--max-open") {
+            if (!opts.next_opt() || !opts.int_opt(&o.max_open_files) || o.max_open_files < 0) {
+                std::cerr<<"Invalid number of open files\n";
+                return -1;
+            }
+        }
+        else if (opt == "--stats") {
+            o.stats = &stats;
+        }
+        else if (opt == "--skip-mipmaps") {
+            o.skip_mipmaps = true;
+        }
+        else if (opt == "-d" || opt == "--downsize") {
+            int n = 0;
+            if (!opts.next_opt() || !opts.int_opt(&n) || n < 1 || n > 15) {
+                std::cerr<<"Downsize should be integer in range 1 to 15 range \n";
+                return -1;
+            }
+            o.downsize = n;
+        }
+        else if (opt == "-c" || opt == "--clampsize") {
+            int n = 0;
+            if (!opts.next_opt() || !opts.int_opt(&n) || !to_log2(n, o.clamp_size)) {
+                std::cerr<<"Invalid power max resolution. Should be positive power of 2\n";
+                return -1;
+            }
+        }
+        else if (opt == "--virtual") {
+            o.virtual_merge = true;
+        }
+        else if (opt == "--no-flatten") {
+            o.flatten_merged = false;
+        }
+        else if (opt == "--digests") {
+            o.digests = true;
+        }
+        else if (opt == "--plan") {
+            do_plan = true;
+        }
+        else if (opt == "--shard-faces" || opt == "--shard-texels" || opt == "--shard-mb") {
+            int n = 0;
+            if (!opts.next_opt() || !opts.int_opt(&n) || n <= 0) {
+                std::cerr<<"Invalid shard limit\n";
+                return -1;
+            }
+            do_shard = true;
+            if (opt == "--shard-faces")
+                budget.faces = n;
+            else if (opt == "--shard-texels")
+                budget.texels = n;
+            else
+                budget.bytes = (int64_t) n << 20;
+        }
+        else if (opt == "--max-memory") {
+            int mb = 0;
+            if (!opts.next_opt() || !opts.int_opt(&mb) || mb < 0) {
+                std::cerr<<"Invalid memory size\n";
+                return -1;
+            }
+            o.max_memory = (size_t) mb << 20;
+        }
         else if (opt == "-h" || opt == "--help") {
             merge_usage(argv[0]);
             return 0;
@@ -151,32 +282,151 @@ int do_ptex_merge(int argc, const char** argv) {
 
     std::vector<int> offsets(nfiles);
     Ptex::String err_msg;
+    if (nfiles < (do_plan ? 1 : 2)) {
+        merge_usage(argv[0]);
+        return -1;
+    }
     if (do_guess) {
-        if (ptex_merge(nfiles-1, files, files[nfiles-1], offsets.data(), err_msg)) {
+        PtexMergeOptions g = o;
+        if (ptex_merge_options(files[0], g, err_msg)) {
             std::cerr<<err_msg.c_str()<<std::endl;
             return -1;
         }
+        o.data_type = g.data_type;
+        o.mesh_type = g.mesh_type;
+        o.num_channels = g.num_channels;
+        o.alpha_channel = g.alpha_channel;
+        o.u_border_mode = g.u_border_mode;
+        o.v_border_mode = g.v_border_mode;
     }
-    else {
-        if (ptex_merge(o, nfiles-1, files, files[nfiles-1], offsets.data(), err_msg)) {
+    if (do_plan) {
+        PtexMergePlan plan;
+        if (ptex_merge_plan(o, nfiles, files, offsets.data(), plan, err_msg)) {
+            std::cerr<<err_msg.c_str()<<std::endl;
+            return -1;
+        }
+        for (int i = 0; i < nfiles; ++i){
+            std::cout<<offsets[i]<<":"<<files[i]<<std::endl;
+        }
+        std::cerr<<"faces: "<<plan.num_faces<<"\n"
+                 <<"constant faces: "<<plan.constant_faces<<"\n"
+                 <<"texels: "<<plan.texels<<"\n"
+                 <<"texel data bytes: "<<plan.data_bytes<<"\n"
+                 <<"estimated output bytes: "<<plan.output_bytes<<"\n"
+                 <<"estimated peak memory bytes: "<<plan.peak_memory<<"\n"
+                 <<"open files: "<<plan.max_open_files<<"\n";
+        return 0;
+    }
+    if (do_shard) {
+        std::vector<int> shards(nfiles);
+        int nshards = 0;
+        if (ptex_merge_sharded(o, budget, nfiles-1, files, files[nfiles-1],
+                               shards.data(), offsets.data(), nshards, err_msg)) {
             std::cerr<<err_msg.c_str()<<std::endl;
             return -1;
         }
+        for (int i = 0; i < nfiles-1; ++i){
+            std::cout<<shards[i]<<":"<<offsets[i]<<":"<<files[i]<<std::endl;
+        }
+        return 0;
+    }
+    if (ptex_merge(o, nfiles-1, files, files[nfiles-1], offsets.data(), err_msg)) {
+        std::cerr<<err_msg.c_str()<<std::endl;
+        return -1;
     }
     for (int i = 0; i < nfiles-1; ++i){
 	std::cout<<offsets[i]<<":"<<files[i]<<std::endl;
     }
+    if (o.stats) {
+        std::cerr<<stats.faces<<" faces, "<<stats.texels<<" texels in "
+                 <<stats.seconds<<" s, "
+                 <<(stats.seconds > 0 ? stats.texels/stats.seconds : 0)
+                 <<" texels/s\n";
+    }
     return 0;
 }
 
+// Reports remerge failures of watch mode and keeps watching, sources
+// may be caught in the middle of writing
+bool report_remerge(int status, const char *err_msg, void *) {
+    if (status)
+        std::cerr<<err_msg<<"\n";
+    return false;
+}
+
 int do_ptex_remerge(int argc, const char** argv) {
     std::string prog = strbasename(argv[0]);
-    if (argc < 4) {
-        std::cerr<<"usage: " << prog <<" merge search/dir texture.ptx\n";
+    PtexRemergeOptions o;
+    bool watch = false;
+    int debounce_ms = 200;
+    OptParse opts(argc-2, argv+2);
+    while(!opts.is_done() && opts.is_flag() ) {
+        std::string opt = opts.get_opt();
+        if (opt == "-j" || opt == "--threads") {
+            if (!opts.next_opt() || !opts.int_opt(&o.num_threads) || o.num_threads < 0) {
+                std::cerr<<"Invalid number of threads\n";
+                return -1;
+            }
+        }
+        else if (opt == "-i" || opt == "--incremental") {
+            o.incremental = true;
+        }
+        else if (opt == "--max-edits") {
+            if (!opts.next_opt() || !opts.int_opt(&o.max_edits) || o.max_edits < 0) {
+                std::cerr<<"Invalid number of edits\n";
+                return -1;
+            }
+        }
+        else if (opt == "--max-edit-mb") {
+            int mb = 0;
+            if (!opts.next_opt() || !opts.int_opt(&mb) || mb < 0) {
+                std::cerr<<"Invalid edit size\n";
+                return -1;
+            }
+            o.max_edit_bytes = size_t(mb) << 20;
+        }
+        else if (opt == "-w" || opt == "--watch") {
+            watch = true;
+        }
+        else if (opt == "--debounce") {
+            if (!opts.next_opt() || !opts.int_opt(&debounce_ms) || debounce_ms < 0) {
+                std::cerr<<"Invalid debounce time\n";
+                return -1;
+            }
+        }
+        else {
+            std::cerr<<"Unknown option: "<<opt<<"\n";
+            return -1;
+        }
+        opts.next_opt();
+    }
+    if (opts.remains() != 2) {
+        std::cerr<<"usage: " << prog <<" remerge [-j N] [-i [--max-edits N]"
+                 <<" [--max-edit-mb MB]] [-w [--debounce MS]]"
+                 <<" search/dir texture.ptx\n\n"
+                 <<"  -i\n"
+                 <<"  --incremental       Append changed faces as edits. Edits are\n"
+                 <<"                      folded once there are more than max-edits\n"
+                 <<"                      (default 16) or they take more than\n"
+                 <<"                      max-edit-mb, 0 - no limit\n\n"
+                 <<"  -w\n"
+                 <<"  --watch             Keep running and remerge incrementally when\n"
+                 <<"                      sources are saved and no writes came for\n"
+                 <<"                      debounce milliseconds (default 200)\n";
 	return -1;
     }
+    const char *searchdir = opts.get_opt();
+    const char *file = opts.next_opt();
     Ptex::String err_msg;
-    int status = ptex_remerge(argv[3], argv[2], err_msg);
+    if (watch) {
+        o.incremental = true;
+        if (ptex_remerge_watch(o, file, searchdir, debounce_ms, report_remerge, 0, err_msg)) {
+            std::cerr<<err_msg.c_str()<<"\n";
+            return -1;
+        }
+        return 0;
+    }
+    int status = ptex_remerge(o, file, searchdir, err_msg);
     if (status) {
         std::cerr<<err_msg.c_str()<<"\n";
         return status;
@@ -185,6 +435,54 @@ int do_ptex_remerge(int argc, const char** argv) {
 
 }
 
+int do_ptex_compact(int argc, const char** argv) {
+    std::string prog = strbasename(argv[0]);
+    if (argc != 3 && argc != 4) {
+        std::cerr<<"usage: " << prog <<" compact input.ptx [output.ptx]\n";
+        return -1;
+    }
+    Ptex::String err_msg;
+    if (ptex_compact(argv[2], argc == 4 ? argv[3] : 0, err_msg)) {
+        std::cerr<<err_msg.c_str()<<"\n";
+        return -1;
+    }
+    return 0;
+}
+
+int do_ptex_split(int argc, const char** argv) {
+    std::string prog = strbasename(argv[0]);
+    int threads = 0;
+    OptParse opts(argc-2, argv+2);
+    while(!opts.is_done() && opts.is_flag() ) {
+        std::string opt = opts.get_opt();
+        if (opt == "-j" || opt == "--threads") {
+            if (!opts.next_opt() || !opts.int_opt(&threads) || threads < 0) {
+                std::cerr<<"Invalid number of threads\n";
+                return -1;
+            }
+        }
+        else {
+            std::cerr<<"Unknown option: "<<opt<<"\n";
+            return -1;
+        }
+        opts.next_opt();
+    }
+    if (opts.remains() != 2) {
+        std::cerr<<"Usage:"<<std::endl
+                 <<prog
+                 <<" split [-j N] merged.ptx output/dir"<<std::endl;
+        return -1;
+    }
+    const char *input = opts.get_opt();
+    const char *output_dir = opts.next_opt();
+    Ptex::String err_msg;
+    if (ptex_split(input, output_dir, threads, err_msg)) {
+        std::cerr<<err_msg.c_str()<<std::endl;
+        return -1;
+    }
+    return 0;
+}
+
 int do_ptex_reverse(int argc, const char** argv) {
     std::string prog = strbasename(argv[0]);
     if (argc != 4) {
@@ -201,6 +499,127 @@ int do_ptex_reverse(int argc, const char** argv) {
     return 0;
 }
 
+void pack_usage(const char* name) {
+    std::cerr<<"Usage:\n  "
+             << strbasename(name)
+             <<" pack [opts] input.ptx[@FIRST[-LAST]] [input2.ptx ..] output.ptx\n\n"
+             <<"  Interleaves channels FIRST to LAST (all by default) of inputs with\n"
+             <<"  same topology into one texture.\n\n"
+             <<"Options: -t DATATYPE\n"
+             <<"         --datatype DATATYPE\n"
+             <<"           Data type of output: uint8, uint16, half or float\n"
+             <<"           [default widest type of inputs]\n"
+             <<"         -a N\n"
+             <<"         --alphachannel N\n"
+             <<"           Alpha channel of output [default -1]\n"
+             <<"         -j N\n"
+             <<"         --threads N\n"
+             <<"           Number of threads packing faces, 0 - all cores [default 0]\n";
+}
+
+// Parses input.ptx@FIRST[-LAST] argument of pack
+bool parse_pack_input(const char* arg, std::string &file, PtexPackInput &input) {
+    file = arg;
+    size_t at = file.rfind('@');
+    if (at == std::string::npos)
+        return true;
+    std::string range = file.substr(at+1);
+    file.resize(at);
+    char *end = 0;
+    long first = strtol(range.c_str(), &end, 10);
+    long last = first;
+    if (end[0] == '-')
+        last = strtol(end+1, &end, 10);
+    if (end == range.c_str() || end[0] != '\0' || first < 0 || last < first)
+        return false;
+    input.first_channel = first;
+    input.num_channels = last - first + 1;
+    return true;
+}
+
+int do_ptex_pack(int argc, const char** argv) {
+    bool guess_dt = true;
+    Ptex::DataType datatype = Ptex::dt_uint8;
+    int alphachan = -1;
+    int threads = 0;
+
+    OptParse opts(argc-2, argv+2);
+    while(!opts.is_done() && opts.is_flag() ) {
+        std::string opt = opts.get_opt();
+        if (opt == "-t" || opt == "--datatype") {
+            std::string dt(opts.next_opt() ? opts.get_opt() : "");
+            if (dt == "uint8")
+                datatype = Ptex::dt_uint8;
+            else if (dt == "uint16")
+                datatype = Ptex::dt_uint16;
+            else if (dt == "half" || dt == "float16")
+                datatype = Ptex::dt_half;
+            else if (dt == "float" || dt == "float32")
+                datatype = Ptex::dt_float;
+            else {
+                std::cerr<<"Invalid datatype specified\n";
+                return -1;
+            }
+            guess_dt = false;
+        }
+        else if (opt == "-a" || opt == "--alphachannel") {
+            if (!opts.next_opt() || !opts.int_opt(&alphachan)) {
+                std::cerr<<"Invalid alpha channel\n";
+                return -1;
+            }
+        }
+        else if (opt == "-j" || opt == "--threads") {
+            if (!opts.next_opt() || !opts.int_opt(&threads) || threads < 0) {
+                std::cerr<<"Invalid number of threads\n";
+                return -1;
+            }
+        }
+        else if (opt == "-h" || opt == "--help") {
+            pack_usage(argv[0]);
+            return 0;
+        }
+        else {
+            std::cerr<<"Unknown option: "<<opt<<"\n\n";
+            pack_usage(argv[0]);
+            return -1;
+        }
+        opts.next_opt();
+    }
+    if (opts.remains() < 2) {
+        pack_usage(argv[0]);
+        return -1;
+    }
+
+    int ninputs = opts.remains() - 1;
+    std::vector<std::string> files(ninputs);
+    std::vector<PtexPackInput> inputs(ninputs);
+    for (int i = 0; i < ninputs; ++i, opts.next_opt()) {
+        if (!parse_pack_input(opts.get_opt(), files[i], inputs[i])) {
+            std::cerr<<"Invalid channel range: "<<opts.get_opt()<<"\n";
+            return -1;
+        }
+        inputs[i].file = files[i].c_str();
+    }
+    const char *output = opts.get_opt();
+
+    Ptex::String err_msg;
+    if (guess_dt) {
+        for (int i = 0; i < ninputs; ++i) {
+            PtexInfo info;
+            if (ptex_info(inputs[i].file, info, err_msg)) {
+                std::cerr<<inputs[i].file<<":"<<err_msg.c_str()<<"\n";
+                return -1;
+            }
+            datatype = std::max(datatype, info.data_type);
+        }
+    }
+    if (ptex_pack(ninputs, inputs.data(), output, datatype, alphachan, threads, err_msg)) {
+        std::cerr<<err_msg.c_str()<<"\n";
+        return -1;
+    }
+    return 0;
+}
+
 void constant_usage(const char* name) {
     std::cerr<<"Usage:\n"
              << strbasename(name)
@@ -217,7 +636,12 @@ void constant_help() {
              <<"         --data N float [float]\n"
              <<"           Data to fill ptex with [default 0]\n"
              <<"         -a N\n"
-             <<"         --alphachannel N\n";
+             <<"         --alphachannel N\n"
+             <<"         -j N\n"
+             <<"         --threads N\n"
+             <<"           Number of threads building adjacency, 0 - all cores [default 0]\n"
+             <<"         --adjacency-cache DIR\n"
+             <<"           Reuse face adjacency of same topology meshes stored in DIR\n";
 }
 
 struct constant_options
@@ -226,6 +650,8 @@ struct constant_options
     std::vector<float> data;
     unsigned int channels = 0;
     int alphachannel = -1;
+    int threads = 0;
+    const char* adjacency_cache = 0;
     const char* objfile;
     const char* ptxfile;
 };
@@ -275,6 +701,19 @@ int parse_constant_options(constant_options &o, int argc, const char** argv)
                 return -1;
             }
         }
+        else if (opt == "-j" || opt == "--threads") {
+            if (!opts.next_opt() || !opts.int_opt(&o.threads) || o.threads < 0) {
+                std::cerr<<"Invalid number of threads\n";
+                return -1;
+            }
+        }
+        else if (opt == "--adjacency-cache") {
+            if (!opts.next_opt()) {
+                constant_usage(argv[0]);
+                return -1;
+            }
+            o.adjacency_cache = opts.get_opt();
+        }
         else if(opt == "-d" || opt == "--data") {
             double v;
             bool status = false;
@@ -296,7 +735,7 @@ int parse_constant_options(constant_options &o, int argc, const char** argv)
         constant_usage(argv[0]);
         return -1;
     }
-    o.objfile = opts.next_opt();
+    o.objfile = opts.get_opt();
     o.ptxfile = opts.next_opt();
 
     if (o.channels == 0) {
@@ -376,7 +815,7 @@ int do_ptex_constant(int argc, const char** argv) {
                       opts.channels,
                       opts.alphachannel, data,
                       mesh.nverts.size(), mesh.nverts.data(), mesh.verts.data(),
-                      mesh.pos.data(), err_msg)) {
+                      mesh.pos.data(), opts.threads, opts.adjacency_cache, err_msg)) {
         std::cerr<<"Error creating "<<opts.ptxfile<<":"
                  <<err_msg.c_str()<<"\n";
         return -1;
@@ -407,31 +846,6 @@ void conform_help() {
              <<"           specified. [default ./backup]\n";
 }
 
-int ipow(int base, int exp)
-{
-    int result = 1;
-    while (exp)
-    {
-        if (exp & 1)
-            result *= base;
-        exp >>= 1;
-        base *= base;
-    }
-    return result;
-}
-
-bool to_log2(int input, int8_t &outp) {
-    if (input < 2 || input > 32768)
-        return false;
-    int inp = input;
-    int8_t log2 = 0;
-    while (inp >>= 1) ++log2;
-    if (ipow(2, log2) != input)
-        return false;
-    outp = log2;
-    return true;
-}
-
 int do_ptex_conform(int argc, const char** argv) {
 
     bool convert_dt = false;
@@ -578,9 +992,12 @@ void usage(const char* name) {
              <<"Commands are:\n"
              <<"   merge     Merge several textures into one\n"
              <<"   remerge   Update merged textures\n"
+             <<"   compact   Fold edits of texture into it\n"
+             <<"   split     Write sources of merged texture to separate files\n"
              <<"   reverse   Reverse winding order in ptex\n"
              <<"   constant  Create constant filled texture from obj file\n"
-             <<"   conform   Conform ptex resolution and data type\n";
+             <<"   conform   Conform ptex resolution and data type\n"
+             <<"   pack      Pack channels of same topology textures into one\n";
 };
 
 int main(int argc, const char** argv){
@@ -595,6 +1012,12 @@ int main(int argc, const char** argv){
     else if (tool == "remerge") {
         return do_ptex_remerge(argc, argv);
     }
+    else if (tool == "compact") {
+        return do_ptex_compact(argc, argv);
+    }
+    else if (tool == "split") {
+        return do_ptex_split(argc, argv);
+    }
     else if (tool == "reverse") {
         return do_ptex_reverse(argc, argv);
     }
@@ -604,6 +1027,9 @@ int main(int argc, const char** argv){
     else if (tool == "conform") {
         return do_ptex_conform(argc, argv);
     }
+    else if (tool == "pack") {
+        return do_ptex_pack(argc, argv);
+    }
     else {
         std::cerr<<"Unknown tool: "<<tool<<"\n";
         usage(argv[0]);
@@ -6,14 +6,14 @@
 
 #include "ptexutils.hpp"
 #include "mesh.hpp"
+#include "helpers.hpp"
+#include "topology.hpp"
 
 
 static
-void write_data(PtexWriter *w, int num_ptex_faces, const half_mesh &mesh, const void* data)
+void write_data(PtexWriter *w, const std::vector<Ptex::FaceInfo> &face_infos, const void* data)
 {
-    std::vector<Ptex::FaceInfo> face_infos(num_ptex_faces);
-    fill_faceinfos(mesh, face_infos.data());
-    for (int i = 0 ; i < num_ptex_faces; ++i) {
+    for (size_t i = 0 ; i < face_infos.size(); ++i) {
         w->writeConstantFace(i, face_infos[i], data);
     }
 }
@@ -26,24 +26,51 @@ int ptex_utils::make_constant(const char* file,
                               int nfaces, int32_t *nverts, int32_t *verts,
                               float* pos, Ptex::String &err_msg)
 {
+    return make_constant(file, dt, nchannels, alphachan, data, nfaces, nverts, verts,
+                         pos, 1, 0, err_msg);
+}
+
+int ptex_utils::make_constant(const char* file,
+                              Ptex::DataType dt,
+                              int nchannels,
+                              int alphachan,
+                              const void* data,
+                              int nfaces, int32_t *nverts, int32_t *verts,
+                              float* pos, int num_threads, Ptex::String &err_msg)
+{
+    return make_constant(file, dt, nchannels, alphachan, data, nfaces, nverts, verts,
+                         pos, num_threads, 0, err_msg);
+}
+
+int ptex_utils::make_constant(const char* file,
+                              Ptex::DataType dt,
+                              int nchannels,
+                              int alphachan,
+                              const void* data,
+                              int nfaces, int32_t *nverts, int32_t *verts,
+                              float* pos, int num_threads, const char *adjacency_cache,
+                              Ptex::String &err_msg)
+{
 
-    int ptex_faces = 0;  //total faces in ptex file
-    int total_faces = 0; //faces count after subdivision
-    int total_edges = 0; //edge count after subdivision
-    count_mesh_elems(nfaces, nverts, total_faces, total_edges, ptex_faces);
+    int ptex_faces = count_ptex_faces(nfaces, nverts);  //total faces in ptex file
     int vcount = 0;      //vertex count
     int fvcount = 0;     //face-vertex count
     count_mesh_vertices(nfaces, nverts, verts, vcount, fvcount);
-    half_mesh mesh(total_faces, total_edges);
-    build_mesh(mesh, nfaces, nverts, verts);
-    PtexWriter *w = PtexWriter::open(file, Ptex::mt_quad, dt, nchannels, alphachan,
-                                     ptex_faces, err_msg, true);
-    write_data(w, ptex_faces, mesh, data);
+    std::vector<Ptex::FaceInfo> face_infos(ptex_faces);
+    compute_adjacency(nfaces, nverts, verts, face_infos.data(), num_threads,
+                      adjacency_cache);
+    WriterPtr w(PtexWriter::open(file, Ptex::mt_quad, dt, nchannels, alphachan,
+                                 ptex_faces, err_msg, true));
+    if (!w)
+        return -1;
+    write_data(w.get(), face_infos, data);
     if (pos) {
         w->writeMeta("PtexFaceVertCounts",  nverts, nfaces);
         w->writeMeta("PtexFaceVertIndices", verts,  fvcount);
         w->writeMeta("PtexVertPositions",   pos,    vcount*3);
     }
-    w->release();
+    write_topology(w.get(), nfaces, nverts, verts);
+    if (!w->close(err_msg))
+        return -1;
     return 0;
 }
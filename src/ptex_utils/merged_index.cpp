@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "ptexutils.hpp"
+#include "helpers.hpp"
+
+using PtexMergedIndex = ptex_utils::PtexMergedIndex;
+
+struct PtexMergedIndex::Impl {
+    std::vector<std::string> names;
+    std::vector<int32_t> offsets;
+    std::vector<int32_t> mesh_offsets;
+    // Offsets padded to power of two size with values larger than any face
+    // id, so search takes same number of steps for every id
+    std::vector<int32_t> search;
+    int32_t num_faces = 0;
+};
+
+PtexMergedIndex::PtexMergedIndex() : _impl(new Impl) {}
+
+PtexMergedIndex::~PtexMergedIndex() {
+    delete _impl;
+}
+
+int PtexMergedIndex::load(const char *file, Ptex::String &err_msg) {
+    PtxPtr ptx(PtexTexture::open(file, err_msg, 0));
+    if (!ptx) {
+        err_msg = "Can't open for reading " + std::string(file) + ":" + err_msg;
+        return -1;
+    }
+    return load(ptx.get(), err_msg);
+}
+
+int PtexMergedIndex::load(PtexTexture *ptex, Ptex::String &err_msg) {
+    MetaPtr meta(ptex->getMetaData());
+    const char *filenames = 0;
+    meta->getValue("PtexMergedFiles", filenames);
+    if (!filenames) {
+        err_msg = "PtexMergedFiles meta not set, probably not a merged file";
+        return -1;
+    }
+    Impl impl;
+    split_names(filenames, impl.names);
+
+    const int32_t *offsets = 0, *mesh_offsets = 0;
+    int noffsets = 0, nmesh_offsets = 0;
+    meta->getValue("PtexMergedOffsets", offsets, noffsets);
+    meta->getValue("PtexMergedMeshOffsets", mesh_offsets, nmesh_offsets);
+    if (!offsets || impl.names.empty() || (size_t) noffsets != impl.names.size()) {
+        err_msg = "Number of offsets and file names in meta does not match";
+        return -1;
+    }
+    impl.num_faces = ptex->numFaces();
+    impl.offsets.assign(offsets, offsets + noffsets);
+    if (impl.offsets[0] < 0 || impl.offsets.back() > impl.num_faces ||
+        !std::is_sorted(impl.offsets.begin(), impl.offsets.end())) {
+        err_msg = "Merged offsets are not ascending face ids";
+        return -1;
+    }
+    if (mesh_offsets && nmesh_offsets == noffsets)
+        impl.mesh_offsets.assign(mesh_offsets, mesh_offsets + nmesh_offsets);
+    else
+        impl.mesh_offsets.assign(noffsets, 0);
+
+    size_t size = 1;
+    while (size < impl.offsets.size())
+        size *= 2;
+    impl.search = impl.offsets;
+    impl.search.resize(size, std::numeric_limits<int32_t>::max());
+
+    std::swap(*_impl, impl);
+    return 0;
+}
+
+int PtexMergedIndex::num_sources() const {
+    return _impl->names.size();
+}
+
+const char* PtexMergedIndex::source(int k) const {
+    return _impl->names[k].c_str();
+}
+
+int32_t PtexMergedIndex::offset(int k) const {
+    return _impl->offsets[k];
+}
+
+int32_t PtexMergedIndex::mesh_offset(int k) const {
+    return _impl->mesh_offsets[k];
+}
+
+void PtexMergedIndex::lookup(int64_t n, const int32_t *face_ids,
+                             int32_t *sources, int32_t *local_ids,
+                             int32_t *mesh_offsets) const {
+    const int32_t *search = _impl->search.data();
+    const size_t size = _impl->search.size();
+    const int32_t num_faces = _impl->num_faces;
+    const int32_t first_face = _impl->offsets[0];
+
+    // Branchless binary search, steps are interleaved over block of ids so
+    // their loads overlap
+    const int lanes = 16;
+    int32_t pos[lanes];
+    for (int64_t first = 0; first < n; first += lanes) {
+        const int m = std::min<int64_t>(lanes, n - first);
+        const int32_t *ids = face_ids + first;
+        std::fill(pos, pos + m, 0);
+        for (size_t half = size / 2; half > 0; half /= 2) {
+            for (int l = 0; l < m; ++l)
+                pos[l] += search[pos[l] + half] <= ids[l] ? half : 0;
+        }
+        for (int l = 0; l < m; ++l) {
+            const int32_t id = ids[l];
+            const bool valid = id >= first_face && id < num_faces;
+            const int32_t k = pos[l];
+            if (sources)
+                sources[first + l] = valid ? k : -1;
+            if (local_ids)
+                local_ids[first + l] = valid ? id - search[k] : -1;
+            if (mesh_offsets)
+                mesh_offsets[first + l] = valid ? _impl->mesh_offsets[k] : -1;
+        }
+    }
+}
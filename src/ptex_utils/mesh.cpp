@@ -1,6 +1,8 @@
-#include <map>
+#include <array>
+#include <mutex>
 
 #include "mesh.hpp"
+#include "parallel.hpp"
 #include "ptexutils.hpp"
 
 void count_mesh_elems(int32_t nfaces, int32_t *nverts,
@@ -38,80 +40,102 @@ void count_mesh_vertices(int32_t nfaces, int32_t *nverts, int32_t *verts,
     ++vcount;
 }
 
-using edge_map_t = std::map<std::pair<int,int>, half_edge*>;
-struct MeshBuilder {
-    half_mesh *mesh;
-    edge_map_t edge_map;
-    int next_edge = 0;
-    int next_face = 0;
-    MeshBuilder(half_mesh *m)
-        : mesh(m)
-    {}
-};
+// Open addressing table of half edges waiting for their opposite, keyed
+// by directed vertex pair. Slots hold edge index only, keys are read from
+// mesh. Edge is inserted only if its opposite is not found and first edge
+// inserted with a key stays, so non manifold edges pair same way as in
+// order of insertion into ordered map.
+class EdgeTable {
+public:
+    EdgeTable(const half_mesh &mesh, size_t nedges) : _mesh(mesh) {
+        size_t size = 16;
+        _shift = 60;
+        while (size < nedges * 2) {
+            size *= 2;
+            --_shift;
+        }
+        _edges.assign(size, -1);
+    }
 
+    static uint64_t key(int32_t v, int32_t w) {
+        return uint64_t(uint32_t(v)) << 32 | uint32_t(w);
+    }
 
-static
-void mark_opposite(MeshBuilder &builder, half_edge *e) {
-    half_edge* n = next_face(e);
-    int v = e->v, w = n->v;
-    auto it = builder.edge_map.find(std::make_pair(w, v));
-    if (it != builder.edge_map.end()) {
-        half_edge *op = it->second;
-        op->opposite = e;
-        e->opposite = op;
+    uint64_t edge_key(int32_t e) const {
+        return key(_mesh.vert[e], _mesh.vert[_mesh.next(e)]);
     }
-    else {
-        builder.edge_map.emplace(std::make_pair(v, w), e);
+
+    // Slot holding key or empty slot where it goes
+    size_t find(uint64_t key) const {
+        const size_t mask = _edges.size() - 1;
+        size_t i = (key * 0x9E3779B97F4A7C15ull) >> _shift;
+        while (_edges[i] != -1 && edge_key(_edges[i]) != key)
+            i = (i + 1) & mask;
+        return i;
     }
-}
 
+    int32_t edge(size_t slot) const { return _edges[slot]; }
+
+    void insert(size_t slot, int32_t edge) { _edges[slot] = edge; }
+
+private:
+    const half_mesh &_mesh;
+    std::vector<int32_t> _edges;
+    int _shift;
+};
+
+// Pairs opposite edges among edge(0)..edge(n-1) in that order
+template <typename EdgeAt>
 static
-half_edge* add_edge(MeshBuilder &builder, int v) {
-    int idx = builder.next_edge++;
-    half_edge& e = builder.mesh->edges[idx];
-    e.v = v;
-    return &e;
+void pair_edge_seq(half_mesh &mesh, size_t n, EdgeAt edge) {
+    EdgeTable table(mesh, n);
+    for (size_t i = 0; i < n; ++i) {
+        const int32_t e = edge(i);
+        const int32_t v = mesh.vert[e], w = mesh.vert[mesh.next(e)];
+        size_t slot = table.find(EdgeTable::key(w, v));
+        if (table.edge(slot) != -1) {
+            const int32_t op = table.edge(slot);
+            mesh.opposite[op] = e;
+            mesh.opposite[e] = op;
+        }
+        else {
+            slot = table.find(EdgeTable::key(v, w));
+            if (table.edge(slot) == -1)
+                table.insert(slot, e);
+        }
+    }
 }
 
-template <typename It>
+// Pairs opposite edges in [first, last) in edge order
 static
-half_face* mark_face(MeshBuilder& builder, bool is_subface, int face_id, It first, It last) {
-    half_edge* f = *first;
-    half_face& face = builder.mesh->faces[face_id];
-    face.face_index = face_id;
-    face.first = f;
-    face.is_subface = is_subface;
-    int face_v = 0;
-
-    half_edge* l = *std::prev(last);
-    l->next = f;
-
-    f->prev = l;
-    f->fv = face_v++;
-    f->face = &face;
-
-    for(It eit = first + 1; eit != last; ++eit) {
-        half_edge* e = *eit;
-        half_edge* p = *std::prev(eit);
-        e->prev = p;
-        e->fv = face_v++;
-        e->face = &face;
-        p->next = e;
-    }
-    for(; first != last; ++first){
-        mark_opposite(builder, *first);
-    }
-    return &face;
+void pair_edges(half_mesh &mesh, int32_t first, int32_t last) {
+    pair_edge_seq(mesh, last - first, [first](size_t i) { return first + int32_t(i); });
 }
 
+struct MeshBuilder {
+    half_mesh *mesh;
+    int next_edge = 0;
+    int next_face = 0;
+    MeshBuilder(half_mesh *m)
+        : mesh(m)
+    {}
+};
+
+// Adds face with vertices [first, last), its edges follow edges of
+// previous face
 template <typename It>
 static
-half_face* add_face(MeshBuilder& builder, It first, It last) {
-    std::vector<half_edge*> edges;
-    std::transform(first, last, std::back_inserter(edges),
-                   [&](int i) -> half_edge* { return add_edge(builder, i); });
-    int idx = builder.next_face++;
-    return mark_face(builder, false, idx, begin(edges), end(edges));
+int32_t add_face(MeshBuilder& builder, It first, It last) {
+    half_mesh &mesh = *builder.mesh;
+    const int32_t face = builder.next_face++;
+    mesh.first_edge[face] = builder.next_edge;
+    for (It v = first; v != last; ++v) {
+        const int32_t e = builder.next_edge++;
+        mesh.vert[e] = *v;
+        mesh.edge_face[e] = face;
+    }
+    mesh.first_edge[face + 1] = builder.next_edge;
+    return face;
 }
 
 static
@@ -128,35 +152,85 @@ int last_vertex(int nfaces, int *nverts, int *verts) {
     return last;
 }
 
+// Subfaces of edge i of non quad are made for edges 1..n-1 and then for
+// edge 0. While face is split, edges of it get subface once their turn
+// came, so split vertices are shared same way as when subfaces were
+// linked to edges as they were made.
+struct SubfaceState {
+    int32_t face = -1;   // face being split
+    int32_t next_fv = 0; // its edges below this, except 0, have subface
+};
+
+static
+int32_t sub_face(const half_mesh &mesh, const SubfaceState &state, int32_t e) {
+    const int32_t f = mesh.edge_face[e];
+    if (mesh.is_subface(f) || mesh.first_subface[f] < 0)
+        return -1;
+    const int32_t fv = mesh.fv(e);
+    if (f == state.face && (fv == 0 || fv >= state.next_fv))
+        return -1;
+    return mesh.first_subface[f] + (fv ? fv - 1 : mesh.face_size(f) - 1);
+}
+
 static
-void assign_subface_adjacency(half_edge *parent) {
-    half_edge *first_adj = opposite(parent);
-    if (first_adj && first_adj->sub_face) {
-        first_adj = prev_face(next_face(first_adj)->sub_face->first);
+void assign_subface_adjacency(half_mesh &mesh, const SubfaceState &state, int32_t parent) {
+    int32_t first_adj = mesh.opposite[parent];
+    if (first_adj != -1 && sub_face(mesh, state, first_adj) != -1) {
+        int32_t sub = sub_face(mesh, state, mesh.next(first_adj));
+        first_adj = mesh.prev(mesh.first_edge[sub]);
     }
-    half_edge *last_adj = prev_vert(parent);
-    if (last_adj && last_adj->sub_face) {
-        last_adj = last_adj->sub_face->first;
+    int32_t last_adj = mesh.opposite[mesh.prev(parent)];
+    if (last_adj != -1 && sub_face(mesh, state, last_adj) != -1) {
+        last_adj = mesh.first_edge[sub_face(mesh, state, last_adj)];
     }
 
-    half_edge *e1 = parent->sub_face->first;
-    half_edge *e2 = next_face(e1);
-    half_edge *e3 = next_face(e2);
-    half_edge *e4 = next_face(e3);
+    const int32_t e1 = mesh.first_edge[sub_face(mesh, state, parent)];
+    const int32_t e2 = e1 + 1;
+    const int32_t e3 = e1 + 2;
+    const int32_t e4 = e1 + 3;
 
-    e1->adjacent = first_adj;
-    e2->adjacent = opposite(e2);
-    e3->adjacent = opposite(e3);
-    e4->adjacent = last_adj;
+    mesh.adjacent[e1] = first_adj;
+    mesh.adjacent[e2] = mesh.opposite[e2];
+    mesh.adjacent[e3] = mesh.opposite[e3];
+    mesh.adjacent[e4] = last_adj;
+}
+
+// Links edges of base faces in [first_face, last_face) and their
+// subfaces to edges of adjacent ptex faces, once all faces are split
+static
+void assign_adjacency(half_mesh &mesh, int32_t first_face, int32_t last_face) {
+    const SubfaceState state;
+    for (int32_t face_id = first_face; face_id < last_face; ++face_id) {
+        const int32_t first = mesh.first_edge[face_id];
+        int32_t e = first;
+        do {
+            if (sub_face(mesh, state, e) != -1) {
+                assign_subface_adjacency(mesh, state, e);
+            } else {
+                int32_t adj = mesh.opposite[e];
+                if (adj != -1 && sub_face(mesh, state, adj) != -1) {
+                    int32_t sub = sub_face(mesh, state, mesh.next(adj));
+                    adj = mesh.prev(mesh.first_edge[sub]);
+                }
+                if (adj != -1) {
+                    mesh.adjacent[e] = adj;
+                }
+            }
+            e = mesh.next(e);
+        } while (e != first);
+    }
 }
 
 static
 void subdiv_mesh(MeshBuilder &builder, int nfaces, int *nverts, int *vertices) {
+    half_mesh &mesh = *builder.mesh;
+    SubfaceState state;
     int next_v = last_vertex(nfaces, nverts, vertices)+1;
-    auto split = [&](const half_edge *e) -> int {
-        half_edge * op = opposite(e);
-        if (op && op->sub_face) {
-            return next_face(op->sub_face->first)->v;
+    auto split = [&](int32_t e) -> int {
+        const int32_t op = mesh.opposite[e];
+        const int32_t sub = op != -1 ? sub_face(mesh, state, op) : -1;
+        if (sub != -1) {
+            return mesh.vert[mesh.first_edge[sub] + 1];
         }
         else {
             return next_v++;
@@ -168,96 +242,253 @@ void subdiv_mesh(MeshBuilder &builder, int nfaces, int *nverts, int *vertices) {
     int ptex_index = 0;
     for (int face_id = 0; face_id < nfaces; ++face_id) {
         int nv = nverts[face_id];
-        half_face &face = builder.mesh->faces[face_id];
-        half_edge *first = face.first;
+        const int32_t first = mesh.first_edge[face_id];
         if (nv == 4) {
-            face.ptex_index = ptex_index++;
+            mesh.ptex_index[face_id] = ptex_index++;
         }
         else {
+            mesh.first_subface[face_id] = builder.next_face;
+            state.face = face_id;
+            state.next_fv = 1;
             const int center_v = next_v++;
             const int first_split = split(first);
             int prev_v = first_split;
-            half_edge* e = next_face(first);
+            int32_t e = mesh.next(first);
             while (e != first) {
                 int split_v = split(e);
-                verts[0] = e->v;
+                verts[0] = mesh.vert[e];
                 verts[1] = split_v;
                 verts[2] = center_v;
                 verts[3] = prev_v;
-                half_face *f = add_face(builder, begin(verts), end(verts));
-                f->is_subface = true;
-                f->ptex_index = ptex_index++;
-                e->sub_face = f;
+                int32_t f = add_face(builder, begin(verts), end(verts));
+                mesh.ptex_index[f] = ptex_index++;
+                ++state.next_fv;
 
-                e = next_face(e);
+                e = mesh.next(e);
                 prev_v = split_v;
 
             }
 
-            verts[0] = first->v;
+            verts[0] = mesh.vert[first];
             verts[1] = first_split;
             verts[2] = center_v;
             verts[3] = prev_v;
 
-            half_face *f = add_face(builder, begin(verts), end(verts));
-            f->is_subface = true;
-            f->ptex_index = ptex_index++;
-            first->sub_face = f;
+            int32_t f = add_face(builder, begin(verts), end(verts));
+            mesh.ptex_index[f] = ptex_index++;
         }
     }
-    for (int face_id = 0; face_id < nfaces; ++face_id) {
-        half_face &face = builder.mesh->faces[face_id];
-        half_edge *first = face.first;
-        half_edge *e = first;
-        do {
-            if (e->sub_face) {
-                assign_subface_adjacency(e);
-            } else {
-                half_edge *adj = opposite(e);
-                if (adj && adj->sub_face) {
-                    adj = prev_face(next_face(adj)->sub_face->first);
-                }
-                if (adj) {
-                    e->adjacent = adj;
+
+    // Subface edges always have new vertex, so they pair only among
+    // themselves
+    pair_edges(mesh, mesh.first_edge[nfaces], builder.next_edge);
+
+    assign_adjacency(mesh, 0, nfaces);
+}
+
+
+void fill_faceinfos(const half_mesh &mesh, Ptex::FaceInfo *faces, int num_threads)
+{
+    const int32_t nfaces = mesh.ptex_index.size();
+    parallel_blocks(nfaces, num_threads, [&](int32_t first, int32_t last) {
+            Ptex::Res res(0,0);
+            int adjfaces[4];
+            int adjedges[4];
+
+            for (int32_t face = first; face < last; ++face) {
+                if (mesh.ptex_index[face] >= 0) {
+                    const int32_t e1 = mesh.first_edge[face];
+                    for (int i = 0; i < 4; ++i) {
+                        adjfaces[i] = adjacent_face(mesh, e1 + i);
+                        adjedges[i] = adjacent_edge(mesh, e1 + i);
+                    }
+
+                    faces[mesh.ptex_index[face]] = Ptex::FaceInfo(res, adjfaces,
+                                                                  adjedges,
+                                                                  mesh.is_subface(face));
                 }
             }
-            e = next_face(e);
-        } while (e != first);
-    }
+        });
 }
 
 
-void fill_faceinfos(const half_mesh &mesh, Ptex::FaceInfo *faces)
-{
-    Ptex::Res res(0,0);
-    int adjfaces[4];
-    int adjedges[4];
-
-    for (const half_face &face : mesh.faces) {
-        if (face.ptex_index >= 0) {
-            half_edge *e1 = face.first;
-            half_edge *e2 = next_face(e1);
-            half_edge *e3 = next_face(e2);
-            half_edge *e4 = next_face(e3);
-            adjfaces[0] = adjacent_face(e1);
-            adjfaces[1] = adjacent_face(e2);
-            adjfaces[2] = adjacent_face(e3);
-            adjfaces[3] = adjacent_face(e4);
-            adjedges[0] = adjacent_edge(e1);
-            adjedges[1] = adjacent_edge(e2);
-            adjedges[2] = adjacent_edge(e3);
-            adjedges[3] = adjacent_edge(e4);
-
-            faces[face.ptex_index] = Ptex::FaceInfo(res, adjfaces,
-                                                    adjedges,
-                                                    face.is_subface);
+// Pairs opposite edges in [first, last) on nthreads threads. Only edges
+// joining same two vertices affect each other, so edges are bucketed by
+// vertex pair keeping edge order and buckets are paired independently.
+static
+void pair_edges_parallel(half_mesh &mesh, int32_t first, int32_t last, int nthreads) {
+    nthreads = resolve_threads(nthreads);
+    const int32_t n = last - first;
+    const int nbuckets = nthreads * 8;
+    auto bucket = [&](int32_t e) {
+        const uint32_t v = mesh.vert[e], w = mesh.vert[mesh.next(e)];
+        // Multiplier differs from one of edge table, else edges of bucket
+        // would crowd into few slots of its table
+        const uint64_t h = EdgeTable::key(std::min(v, w), std::max(v, w))
+            * 0xC2B2AE3D27D4EB4Full;
+        return int((h >> 32) * nbuckets >> 32);
+    };
+
+    const int nblocks = nthreads;
+    const int32_t block = (n + nblocks - 1) / nblocks;
+    std::vector<int32_t> pos(nblocks * nbuckets, 0);
+    parallel_for(nblocks, nthreads, [&](int b) {
+            int32_t *count = &pos[b * nbuckets];
+            const int32_t end = std::min(n, (b + 1) * block);
+            for (int32_t i = b * block; i < end; ++i)
+                ++count[bucket(first + i)];
+        });
+    // Bucket holds edges of first block, then of second and so on
+    std::vector<int32_t> offsets(nbuckets + 1, 0);
+    int32_t offset = 0;
+    for (int k = 0; k < nbuckets; ++k) {
+        offsets[k] = offset;
+        for (int b = 0; b < nblocks; ++b) {
+            const int32_t count = pos[b * nbuckets + k];
+            pos[b * nbuckets + k] = offset;
+            offset += count;
         }
     }
+    offsets[nbuckets] = offset;
+    std::vector<int32_t> order(n);
+    parallel_for(nblocks, nthreads, [&](int b) {
+            int32_t *next = &pos[b * nbuckets];
+            const int32_t end = std::min(n, (b + 1) * block);
+            for (int32_t i = b * block; i < end; ++i)
+                order[next[bucket(first + i)]++] = first + i;
+        });
+    parallel_for(nbuckets, nthreads, [&](int k) {
+            const int32_t *edges = order.data() + offsets[k];
+            pair_edge_seq(mesh, offsets[k + 1] - offsets[k],
+                          [edges](size_t i) { return edges[i]; });
+        });
+}
 
+// Builds same mesh as serial builder on nthreads threads. Face, edge, ptex
+// face and new vertex numbers of each face come from prefix sums, which
+// split vertices are shared follows from opposite edges and order serial
+// subdivision splits faces in.
+static
+void build_mesh_parallel(half_mesh &mesh, int nfaces, int *nverts, int *verts,
+                         int nthreads) {
+    int32_t *first_edge = mesh.first_edge.data();
+    parallel_prefix_sum(nfaces, nthreads, [nverts](int f) { return int32_t(nverts[f]); },
+                        first_edge);
+    const int32_t base_edges = first_edge[nfaces];
+    std::mutex m;
+    int last_v = 0;
+    parallel_blocks(nfaces, nthreads, [&](int first, int last) {
+            int last_block_v = 0;
+            for (int32_t f = first; f < last; ++f) {
+                for (int32_t e = first_edge[f]; e < first_edge[f+1]; ++e) {
+                    mesh.vert[e] = verts[e];
+                    mesh.edge_face[e] = f;
+                    last_block_v = std::max(last_block_v, verts[e]);
+                }
+            }
+            std::lock_guard<std::mutex> lock(m);
+            last_v = std::max(last_v, last_block_v);
+        });
+    mesh.num_base_faces = nfaces;
+    pair_edges_parallel(mesh, 0, base_edges, nthreads);
+
+    // Split vertex of edge is shared with opposite edge split before it.
+    // Faces are split in order, edges of face from second one and first
+    // one last, but first split is made before others.
+    auto shared_split = [&](int32_t e) {
+        const int32_t op = mesh.opposite[e];
+        if (op == -1)
+            return false;
+        const int32_t f = mesh.edge_face[e], g = mesh.edge_face[op];
+        if (mesh.face_size(g) == 4 || g > f)
+            return false;
+        if (g < f)
+            return true;
+        const int32_t k = mesh.fv(e), kop = mesh.fv(op);
+        return k > 0 && kop > 0 && kop < k;
+    };
+
+    std::vector<int32_t> subfaces(nfaces + 1), ptex_faces(nfaces + 1), new_verts(nfaces + 1);
+    parallel_prefix_sum(nfaces, nthreads, [nverts](int f) {
+            return int32_t(nverts[f] == 4 ? 0 : nverts[f]);
+        }, subfaces.data());
+    parallel_prefix_sum(nfaces, nthreads, [nverts](int f) {
+            return int32_t(nverts[f] == 4 ? 1 : nverts[f]);
+        }, ptex_faces.data());
+    parallel_prefix_sum(nfaces, nthreads, [&](int f) {
+            if (nverts[f] == 4)
+                return 0;
+            int count = 1;
+            for (int32_t e = first_edge[f]; e < first_edge[f+1]; ++e)
+                count += !shared_split(e);
+            return count;
+        }, new_verts.data());
+
+    // New split vertices, -1 for shared ones
+    std::vector<int32_t> split(base_edges, -1);
+    parallel_blocks(nfaces, nthreads, [&](int first, int last) {
+            for (int32_t f = first; f < last; ++f) {
+                if (nverts[f] == 4)
+                    continue;
+                int32_t v = last_v + 1 + new_verts[f] + 1;
+                for (int32_t e = first_edge[f]; e < first_edge[f+1]; ++e) {
+                    if (!shared_split(e))
+                        split[e] = v++;
+                }
+            }
+        });
+    auto split_vertex = [&](int32_t e) {
+        while (split[e] == -1)
+            e = mesh.opposite[e];
+        return split[e];
+    };
+
+    parallel_blocks(nfaces, nthreads, [&](int first, int last) {
+            for (int32_t f = first; f < last; ++f) {
+                const int nv = nverts[f];
+                if (nv == 4) {
+                    mesh.ptex_index[f] = ptex_faces[f];
+                    continue;
+                }
+                const int32_t first_sub = nfaces + subfaces[f];
+                const int32_t center_v = last_v + 1 + new_verts[f];
+                mesh.first_subface[f] = first_sub;
+                for (int k = 0; k < nv; ++k) {
+                    const int32_t e = first_edge[f] + k;
+                    const int32_t j = k ? k - 1 : nv - 1;
+                    const int32_t sub = first_sub + j;
+                    const int32_t se = base_edges + 4 * (subfaces[f] + j);
+                    // End of base edges already starts first subface and
+                    // is read by other blocks through prev
+                    if (sub != nfaces)
+                        first_edge[sub] = se;
+                    mesh.ptex_index[sub] = ptex_faces[f] + j;
+                    mesh.vert[se] = mesh.vert[e];
+                    mesh.vert[se + 1] = split_vertex(e);
+                    mesh.vert[se + 2] = center_v;
+                    mesh.vert[se + 3] = split_vertex(mesh.prev(e));
+                    for (int i = 0; i < 4; ++i)
+                        mesh.edge_face[se + i] = sub;
+                }
+            }
+        });
+    const int32_t total_faces = nfaces + subfaces[nfaces];
+    const int32_t total_edges = base_edges + 4 * subfaces[nfaces];
+    first_edge[total_faces] = total_edges;
+
+    pair_edges_parallel(mesh, base_edges, total_edges, nthreads);
+
+    parallel_blocks(nfaces, nthreads, [&](int first, int last) {
+            assign_adjacency(mesh, first, last);
+        });
 }
 
 
-void build_mesh(half_mesh &mesh, int nfaces, int *nverts, int *verts) {
+void build_mesh(half_mesh &mesh, int nfaces, int *nverts, int *verts, int num_threads) {
+    if (resolve_threads(num_threads) > 1) {
+        build_mesh_parallel(mesh, nfaces, nverts, verts, num_threads);
+        return;
+    }
     MeshBuilder builder(&mesh);
 
     int first = 0;
@@ -266,6 +497,8 @@ void build_mesh(half_mesh &mesh, int nfaces, int *nverts, int *verts) {
         add_face(builder, verts+first, verts+first+nv);
         first += nv;
     }
+    mesh.num_base_faces = nfaces;
+    pair_edges(mesh, 0, builder.next_edge);
     subdiv_mesh(builder, nfaces, nverts, verts);
 }
 
@@ -283,6 +516,12 @@ int32_t ptex_utils::count_ptex_faces(int32_t nfaces, int32_t *nverts)
 void ptex_utils::compute_adjacency(int32_t nfaces, int32_t *nverts, int32_t *verts,
                                    Ptex::FaceInfo *out)
 {
+    compute_adjacency(nfaces, nverts, verts, out, 1);
+}
+
+void ptex_utils::compute_adjacency(int32_t nfaces, int32_t *nverts, int32_t *verts,
+                                   Ptex::FaceInfo *out, int num_threads)
+{
 
     int ptex_faces = 0;  //total faces in ptex file
     int total_faces = 0; //faces count after subdivision
@@ -290,9 +529,9 @@ void ptex_utils::compute_adjacency(int32_t nfaces, int32_t *nverts, int32_t *ver
     count_mesh_elems(nfaces, nverts, total_faces, total_edges, ptex_faces);
 
     half_mesh mesh(total_faces, total_edges);
-    build_mesh(mesh, nfaces, nverts, verts);
+    build_mesh(mesh, nfaces, nverts, verts, num_threads);
 
-    fill_faceinfos(mesh, out);
+    fill_faceinfos(mesh, out, num_threads);
 }
 
 bool ptex_utils::ptex_topology_match(int32_t n, const Ptex::FaceInfo *nfaces,
@@ -307,7 +546,7 @@ bool ptex_utils::ptex_topology_match(int32_t n, const Ptex::FaceInfo *nfaces,
             return false;
         for (int f = 0; f < 4; ++f) {
             if (nface.adjfaces[f] == -1) {
-                if (nface.adjfaces[f] == -1)
+                if (mface.adjfaces[f] == -1)
                     continue;
                 else
                     return false;
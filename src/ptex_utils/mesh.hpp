@@ -6,78 +6,65 @@
 
 #include <Ptexture.h>
 
-struct half_face;
-
-struct half_edge {
-    half_face* face;
-    int32_t v;
-    int32_t fv;
-    half_edge* opposite = 0;
-    half_edge* next = 0;
-    half_edge* prev  = 0;
-    half_face* sub_face = 0;
-    half_edge* adjacent = 0;
-    half_edge(half_face *face, int32_t face_v, int32_t v)
-        : face(face)
-        , v(v)
-        , fv(face_v)
-        , opposite(0), next(0), prev(0)
-        {};
-    half_edge() = default;
-};
-
-
-struct half_face {
-    int32_t face_index = -1;
-    int32_t ptex_index = -1;
-    int32_t is_subface = false;
-    half_edge* first = 0;
-};
-
+// Half edge mesh of faces subdivided for ptex, stored as arrays of 32 bit
+// indices. Edges of face are contiguous, so next and previous edge come
+// from edge range of face. Base faces come first, subfaces of non quad
+// faces follow them. Missing edge or face is -1.
 struct half_mesh {
-    std::vector<half_edge> edges;
-    std::vector<half_face> faces;
+    // Per edge
+    std::vector<int32_t> vert;      // vertex edge starts at
+    std::vector<int32_t> edge_face;
+    std::vector<int32_t> opposite;
+    std::vector<int32_t> adjacent;  // edge of adjacent ptex face
+    // Per face, first_edge has extra entry ending last face
+    std::vector<int32_t> first_edge;
+    std::vector<int32_t> ptex_index;
+    std::vector<int32_t> first_subface; // of non quad base face
+    int32_t num_base_faces = 0;
+
     half_mesh(int32_t nfaces, int32_t nedges)
-        : edges(nedges)
-        , faces(nfaces)
+        : vert(nedges)
+        , edge_face(nedges)
+        , opposite(nedges, -1)
+        , adjacent(nedges, -1)
+        , first_edge(nfaces + 1, 0)
+        , ptex_index(nfaces, -1)
+        , first_subface(nfaces, -1)
         {}
-};
 
-inline
-half_edge* next_face(const half_edge *e) { return e->next; };
+    int32_t face_size(int32_t f) const { return first_edge[f+1] - first_edge[f]; }
+    bool is_subface(int32_t f) const { return f >= num_base_faces; }
 
-inline
-half_edge* prev_face(const half_edge *e) { return e->prev; };
+    // Index of edge in its face
+    int32_t fv(int32_t e) const { return e - first_edge[edge_face[e]]; }
 
-inline
-half_edge* opposite(const half_edge *e) { return e->opposite; };
-
-
-inline
-half_edge* next_vert(const half_edge *e) {
-    half_edge *op = opposite(e);
-    return op == 0 ? 0 : next_face(op);
-}
+    int32_t next(int32_t e) const {
+        const int32_t f = edge_face[e];
+        return e + 1 == first_edge[f+1] ? first_edge[f] : e + 1;
+    }
 
-inline
-half_edge* prev_vert(half_edge *e) {
-    return opposite(prev_face(e));
-}
+    int32_t prev(int32_t e) const {
+        const int32_t f = edge_face[e];
+        return e == first_edge[f] ? first_edge[f+1] - 1 : e - 1;
+    }
+};
 
 inline
-int adjacent_face(const half_edge *e){
-    if (e->adjacent)
-        return e->adjacent->face->ptex_index;
+int adjacent_face(const half_mesh &mesh, int32_t e){
+    const int32_t adj = mesh.adjacent[e];
+    if (adj != -1)
+        return mesh.ptex_index[mesh.edge_face[adj]];
     else
         return -1;
 }
 
 inline
-int adjacent_edge(const half_edge *e) {
-   if (e->adjacent)
-       return e->adjacent->fv;
-   else
-       return 0;
+int adjacent_edge(const half_mesh &mesh, int32_t e) {
+    const int32_t adj = mesh.adjacent[e];
+    if (adj != -1)
+        return mesh.fv(adj);
+    else
+        return 0;
 }
 
 
@@ -87,6 +74,10 @@ void count_mesh_elems(int32_t nfaces, int32_t *nverts,
 void count_mesh_vertices(int32_t nfaces, int32_t *nverts, int32_t *verts,
                          int32_t &vcount, int32_t &fvcount);
 
-void build_mesh(half_mesh &mesh, int nfaces, int *nverts, int *verts);
+// Both run on num_threads threads, 0 - all cores, and give same result
+// for any number of threads.
+void build_mesh(half_mesh &mesh, int nfaces, int *nverts, int *verts,
+                int num_threads = 1);
 
-void fill_faceinfos(const half_mesh &mesh, Ptex::FaceInfo *faces);
+void fill_faceinfos(const half_mesh &mesh, Ptex::FaceInfo *faces,
+                    int num_threads = 1);
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ptexutils.hpp"
+
+using PtexMeshEdit = ptex_utils::PtexMeshEdit;
+
+namespace {
+
+int32_t ptex_count(int32_t nv) {
+    return nv == 4 ? 1 : nv;
+}
+
+// Edges joining same two vertices pair with each other only, so pairing
+// of edge depends on faces having edge on its vertex pair. Set is checked
+// for every edge of mesh, vertex flags skip hashing of most of them.
+class VertexPairs {
+public:
+    explicit VertexPairs(int32_t nverts) : _verts(nverts, 0) {}
+
+    void insert(int32_t v, int32_t w) {
+        _verts[v] = _verts[w] = 1;
+        _pairs.insert(key(v, w));
+    }
+
+    bool contains(int32_t v, int32_t w) const {
+        return _verts[v] && _verts[w] && _pairs.count(key(v, w));
+    }
+
+private:
+    static uint64_t key(int32_t v, int32_t w) {
+        return uint64_t(uint32_t(std::min(v, w))) << 32 | uint32_t(std::max(v, w));
+    }
+
+    std::vector<char> _verts;
+    std::unordered_set<uint64_t> _pairs;
+};
+
+// Faces of edited mesh, remaining old faces in order followed by added
+struct EditedMesh {
+    std::vector<int32_t> old_face;   // old face id, -1 if added
+    std::vector<int32_t> nverts;
+    std::vector<const int32_t*> verts;
+    std::vector<int32_t> first_ptex; // has extra entry with total
+
+    int32_t size() const { return nverts.size(); }
+};
+
+template <typename Fn>
+void for_each_edge(int32_t nv, const int32_t *verts, Fn fn) {
+    for (int32_t k = 0; k < nv; ++k)
+        fn(verts[k], verts[k + 1 < nv ? k + 1 : 0]);
+}
+
+}
+
+int32_t ptex_utils::count_ptex_faces(int32_t nfaces, const int32_t *nverts,
+                                     const PtexMeshEdit &edit)
+{
+    int32_t ptex_faces = 0;
+    for (int32_t face = 0; face < nfaces; ++face)
+        ptex_faces += ptex_count(nverts[face]);
+    for (int32_t k = 0; k < edit.num_removed; ++k)
+        ptex_faces -= ptex_count(nverts[edit.removed[k]]);
+    for (int32_t k = 0; k < edit.num_added; ++k)
+        ptex_faces += ptex_count(edit.added_nverts[k]);
+    return ptex_faces;
+}
+
+int ptex_utils::update_adjacency(int32_t nfaces, const int32_t *nverts, const int32_t *verts,
+                                 const Ptex::FaceInfo *faces, const PtexMeshEdit &edit,
+                                 Ptex::FaceInfo *out, int32_t *face_remap,
+                                 Ptex::String &err_msg)
+{
+    for (int32_t k = 0; k < edit.num_removed; ++k) {
+        const int32_t f = edit.removed[k];
+        if (f < 0 || f >= nfaces || (k && f <= edit.removed[k - 1])) {
+            err_msg = "Removed faces are not ascending face ids of mesh";
+            return -1;
+        }
+    }
+    for (int32_t k = 0; k < edit.num_added; ++k) {
+        if (edit.added_nverts[k] < 3) {
+            err_msg = "Added face " + std::to_string(k) + " has fewer than 3 vertices";
+            return -1;
+        }
+    }
+
+    std::vector<const int32_t*> old_verts(nfaces);
+    std::vector<int32_t> old_first_ptex(nfaces + 1, 0);
+    int32_t nvertices = 0;
+    const int32_t *fv = verts;
+    for (int32_t f = 0; f < nfaces; ++f) {
+        old_verts[f] = fv;
+        for (int32_t k = 0; k < nverts[f]; ++k)
+            nvertices = std::max(nvertices, fv[k] + 1);
+        fv += nverts[f];
+        old_first_ptex[f + 1] = old_first_ptex[f] + ptex_count(nverts[f]);
+    }
+    fv = edit.added_verts;
+    for (int32_t k = 0; k < edit.num_added; ++k) {
+        for (int32_t i = 0; i < edit.added_nverts[k]; ++i) {
+            if (fv[i] < 0) {
+                err_msg = "Added face " + std::to_string(k) + " has negative vertex index";
+                return -1;
+            }
+            nvertices = std::max(nvertices, fv[i] + 1);
+        }
+        fv += edit.added_nverts[k];
+    }
+
+    // Vertex pairs of removed and added edges
+    VertexPairs touched(nvertices);
+    auto touch = [&](int32_t v, int32_t w) { touched.insert(v, w); };
+
+    EditedMesh mesh;
+    std::fill(face_remap, face_remap + old_first_ptex[nfaces], -1);
+    mesh.first_ptex.push_back(0);
+    int32_t next_removed = 0;
+    for (int32_t f = 0; f < nfaces; ++f) {
+        if (next_removed < edit.num_removed && edit.removed[next_removed] == f) {
+            ++next_removed;
+            for_each_edge(nverts[f], old_verts[f], touch);
+            continue;
+        }
+        const int32_t ptex = mesh.first_ptex.back();
+        for (int32_t j = 0; j < ptex_count(nverts[f]); ++j)
+            face_remap[old_first_ptex[f] + j] = ptex + j;
+        mesh.old_face.push_back(f);
+        mesh.nverts.push_back(nverts[f]);
+        mesh.verts.push_back(old_verts[f]);
+        mesh.first_ptex.push_back(ptex + ptex_count(nverts[f]));
+    }
+    fv = edit.added_verts;
+    for (int32_t k = 0; k < edit.num_added; ++k) {
+        const int32_t nv = edit.added_nverts[k];
+        for_each_edge(nv, fv, touch);
+        mesh.old_face.push_back(-1);
+        mesh.nverts.push_back(nv);
+        mesh.verts.push_back(fv);
+        mesh.first_ptex.push_back(mesh.first_ptex.back() + ptex_count(nv));
+        fv += nv;
+    }
+
+    // Face infos change only for faces with edge on touched vertex pair.
+    // They depend on all faces sharing vertex pairs with their edges, which
+    // are built as separate mesh keeping their order.
+    std::vector<char> affected(mesh.size(), 0);
+    VertexPairs neighborhood(nvertices);
+    for (int32_t f = 0; f < mesh.size(); ++f) {
+        bool hit = mesh.old_face[f] == -1;
+        for_each_edge(mesh.nverts[f], mesh.verts[f], [&](int32_t v, int32_t w) {
+                hit = hit || touched.contains(v, w);
+            });
+        if (hit) {
+            affected[f] = 1;
+            for_each_edge(mesh.nverts[f], mesh.verts[f], [&](int32_t v, int32_t w) {
+                    neighborhood.insert(v, w);
+                });
+        }
+    }
+    std::vector<int32_t> local_faces;
+    std::vector<int32_t> local_nverts, local_verts;
+    std::vector<int32_t> local_first_ptex(1, 0);
+    for (int32_t f = 0; f < mesh.size(); ++f) {
+        bool hit = affected[f];
+        for_each_edge(mesh.nverts[f], mesh.verts[f], [&](int32_t v, int32_t w) {
+                hit = hit || neighborhood.contains(v, w);
+            });
+        if (!hit)
+            continue;
+        local_faces.push_back(f);
+        local_nverts.push_back(mesh.nverts[f]);
+        local_verts.insert(local_verts.end(), mesh.verts[f], mesh.verts[f] + mesh.nverts[f]);
+        local_first_ptex.push_back(local_first_ptex.back() + ptex_count(mesh.nverts[f]));
+    }
+    std::vector<Ptex::FaceInfo> local(local_first_ptex.back());
+    compute_adjacency(local_nverts.size(), local_nverts.data(), local_verts.data(),
+                      local.data());
+
+    auto local_to_new = [&](int32_t id) -> int32_t {
+        if (id < 0)
+            return -1;
+        const size_t i = std::upper_bound(local_first_ptex.begin(), local_first_ptex.end(), id)
+            - local_first_ptex.begin() - 1;
+        return mesh.first_ptex[local_faces[i]] + id - local_first_ptex[i];
+    };
+
+    size_t next_local = 0;
+    for (int32_t f = 0; f < mesh.size(); ++f) {
+        while (next_local < local_faces.size() && local_faces[next_local] < f)
+            ++next_local;
+        const int32_t old = mesh.old_face[f];
+        const int32_t n = mesh.first_ptex[f + 1] - mesh.first_ptex[f];
+        for (int32_t j = 0; j < n; ++j) {
+            Ptex::FaceInfo &info = out[mesh.first_ptex[f] + j];
+            if (!affected[f]) {
+                info = faces[old_first_ptex[old] + j];
+                for (int e = 0; e < 4; ++e) {
+                    if (info.adjfaces[e] >= 0)
+                        info.adjfaces[e] = face_remap[info.adjfaces[e]];
+                }
+                continue;
+            }
+            info = local[local_first_ptex[next_local] + j];
+            for (int e = 0; e < 4; ++e)
+                info.adjfaces[e] = local_to_new(info.adjfaces[e]);
+            if (old >= 0) {
+                const Ptex::FaceInfo &prev = faces[old_first_ptex[old] + j];
+                info.res = prev.res;
+                info.flags = prev.flags;
+            }
+        }
+    }
+    return 0;
+}
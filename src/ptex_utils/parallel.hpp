@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of threads to use, 0 or less means all hardware threads.
+inline
+int resolve_threads(int nthreads) {
+    if (nthreads > 0)
+        return nthreads;
+    int hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+// Calls fn(i) for every i in [0, n) using up to nthreads threads.
+template <typename Fn>
+void parallel_for(int n, int nthreads, Fn fn) {
+    nthreads = std::min(resolve_threads(nthreads), n);
+    if (nthreads <= 1) {
+        for (int i = 0; i < n; ++i)
+            fn(i);
+        return;
+    }
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        for (int i = next++; i < n; i = next++)
+            fn(i);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nthreads; ++t)
+        threads.emplace_back(work);
+    work();
+    for (std::thread &t : threads)
+        t.join();
+}
+
+// Splits [0, n) into contiguous blocks and calls fn(begin, end) for each
+// block using up to nthreads threads.
+template <typename Fn>
+void parallel_blocks(int n, int nthreads, Fn fn) {
+    nthreads = resolve_threads(nthreads);
+    const int nblocks = std::min(n, nthreads * 8);
+    if (nthreads <= 1 || nblocks <= 1) {
+        fn(0, n);
+        return;
+    }
+    const int block = (n + nblocks - 1) / nblocks;
+    parallel_for((n + block - 1) / block, nthreads, [&](int b) {
+            fn(b * block, std::min(n, (b + 1) * block));
+        });
+}
+
+// Writes sums of count(j) for j < i to out[i] for i in [0, n], out[n] gets
+// total. Uses up to nthreads threads, count(i) is called once for each i.
+template <typename T, typename Count>
+void parallel_prefix_sum(int n, int nthreads, Count count, T *out) {
+    nthreads = std::max(1, std::min(resolve_threads(nthreads), n));
+    const int block = (n + nthreads - 1) / nthreads;
+    std::vector<T> sums(nthreads + 1, T());
+    auto partial = [&](int b) {
+        const int last = std::min(n, (b + 1) * block);
+        T sum = T();
+        for (int i = b * block; i < last; ++i) {
+            sum += count(i);
+            out[i + 1] = sum;
+        }
+        sums[b + 1] = sum;
+    };
+    parallel_for(nthreads, nthreads, partial);
+    for (int b = 0; b < nthreads; ++b)
+        sums[b + 1] += sums[b];
+    out[0] = T();
+    parallel_for(nthreads, nthreads, [&](int b) {
+            const int last = std::min(n, (b + 1) * block);
+            for (int i = b * block; i < last; ++i)
+                out[i + 1] += sums[b];
+        });
+}
+
+// Runs produce(worker, i, slot) for i in [0, n) on nthreads worker threads
+// and consume(i, slot) on the calling thread in increasing i order. Item i
+// is produced into slots[i % slots.size()], so at most slots.size() items
+// are in flight. Both callbacks return 0 on success, first non zero status
+// stops the pipeline and is returned.
+template <typename Slot, typename Produce, typename Consume>
+int ordered_pipeline(int n, int nthreads, std::vector<Slot> &slots,
+                     Produce produce, Consume consume) {
+    nthreads = std::min(resolve_threads(nthreads), n);
+    if (nthreads <= 1 || slots.size() < 2) {
+        for (int i = 0; i < n; ++i) {
+            Slot &slot = slots[0];
+            int status = produce(0, i, slot);
+            if (status)
+                return status;
+            status = consume(i, slot);
+            if (status)
+                return status;
+        }
+        return 0;
+    }
+
+    const int window = slots.size();
+    std::mutex m;
+    std::condition_variable produced, consumed;
+    std::vector<char> ready(window, 0);
+    int next = 0;
+    int done = 0;
+    int status = 0;
+
+    auto work = [&](int worker) {
+        for (;;) {
+            int i;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                consumed.wait(lock, [&]() {
+                        return status || next >= n || next < done + window;
+                    });
+                if (status || next >= n)
+                    return;
+                i = next++;
+            }
+            int r = produce(worker, i, slots[i % window]);
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (r && !status)
+                    status = r;
+                ready[i % window] = 1;
+            }
+            produced.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; ++t)
+        threads.emplace_back(work, t);
+
+    for (int i = 0; i < n; ++i) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            produced.wait(lock, [&]() { return status || ready[i % window]; });
+            if (status)
+                break;
+        }
+        int r = consume(i, slots[i % window]);
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (r && !status)
+                status = r;
+            ready[i % window] = 0;
+            done = i + 1;
+        }
+        consumed.notify_all();
+        if (r)
+            break;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (!status && done < n)
+            status = -1;
+    }
+    consumed.notify_all();
+    for (std::thread &t : threads)
+        t.join();
+    return status;
+}
@@ -3,6 +3,7 @@
 #include <Ptexture.h>
 
 #include "ptexutils.hpp"
+#include "convert.hpp"
 #include "helpers.hpp"
 
 
@@ -14,7 +15,7 @@ int ptex_utils::ptex_conform(const char* filename,
                              Ptex::DataType out_dt,
                              Ptex::String &err_msg)
 {
-    PtxPtr ptx(PtexTexture::open(filename, err_msg, 0));
+    PtxPtr ptx(ptex_open(filename, 0, err_msg));
     if (!ptx) {
         err_msg = "Can't open for reading " + std::string(filename) + ":" + err_msg;
         return -1;
@@ -40,33 +41,39 @@ int ptex_utils::ptex_conform(const char* filename,
         return -1;
     }
 
-    int8_t clamp_log = clampsize <= 0 ? 15 : clampsize;
-    Ptex::Res clamp_res(clamp_log, clamp_log);
-
     const size_t input_pixel_size = Ptex::DataSize(ptx->dataType()) * nchannels;
     const size_t pixel_size = Ptex::DataSize(dt)*nchannels;
 
     std::vector<char> in_buffer(input_pixel_size*128*128);
     std::vector<char> out_buffer(pixel_size*128*128);
-    std::vector<float> fdata(nchannels*128*128);
 
     for (int face_id = 0; face_id < nfaces; ++face_id) {
         Ptex::FaceInfo face_info = ptx->getFaceInfo(face_id);
 
-        if (!face_info.isConstant()) {
-            Ptex::Res res = face_info.res;
-            res.ulog2 = res.ulog2 > 2 ? std::max(1, res.ulog2 - downsteps) : res.ulog2;
-            res.vlog2 = res.vlog2 > 2 ? std::max(1, res.vlog2 - downsteps) : res.vlog2;
-            res.clamp(clamp_res);
-            face_info.res = res;
+        // Faces kept at full resolution are converted tile by tile
+        Ptex::Res full_res = face_info.res;
+        face_info.res = conform_res(face_info, downsteps, clampsize);
+        if (!face_info.isConstant() && face_info.res == full_res) {
+            const size_t out_size = pixel_size * full_res.size();
+            if (out_buffer.size() < out_size) {
+                out_buffer.resize(out_size);
+            }
+            if (read_face_tiles(ptx.get(), face_id, out_buffer.data(), dt, nchannels)) {
+                writer->writeFace(face_id, face_info, out_buffer.data(), 0);
+                continue;
+            }
         }
 
-        const size_t input_size = input_pixel_size * face_info.res.size();
+        // Only value of constant face is read and converted
+        const Ptex::Res res = face_info.isConstant() ? Ptex::Res(0, 0) : face_info.res;
+        const size_t npixels = res.size();
+
+        const size_t input_size = input_pixel_size * npixels;
         if (in_buffer.size() < input_size) {
             in_buffer.resize(input_size);
         }
 
-        ptx->getData(face_id, in_buffer.data(), 0, face_info.res);
+        ptx->getData(face_id, in_buffer.data(), 0, res);
 
         if (dt == input_dt) {
             if (face_info.isConstant()) {
@@ -77,19 +84,13 @@ int ptex_utils::ptex_conform(const char* filename,
             }
         }
         else {
-            const size_t out_size = pixel_size * face_info.res.size();
-            const size_t float_size = nchannels*face_info.res.size();
+            const size_t out_size = pixel_size * npixels;
             if (out_buffer.size() < out_size) {
                 out_buffer.resize(out_size);
             }
-            if (fdata.size() < float_size) {
-                fdata.resize(float_size);
-            }
 
-            Ptex::ConvertToFloat(fdata.data(), in_buffer.data(), input_dt,
-                                 nchannels*face_info.res.size());
-            Ptex::ConvertFromFloat(out_buffer.data(), fdata.data(),
-                                   dt, nchannels*face_info.res.size());
+            convert_pixels(out_buffer.data(), dt, in_buffer.data(), input_dt,
+                           nchannels, nchannels, npixels);
 
             if (face_info.isConstant()) {
                 writer->writeConstantFace(face_id, face_info, out_buffer.data());
@@ -102,6 +103,14 @@ int ptex_utils::ptex_conform(const char* filename,
 
     MetaPtr meta_ptr(ptx->getMetaData());
     writer->writeMeta(meta_ptr.get());
+    // Faces of virtual merge are written now, output reads them itself
+    const int8_t *is_virtual = 0;
+    int count = 0;
+    meta_ptr->getValue("PtexVirtualMerge", is_virtual, count);
+    if (is_virtual) {
+        int8_t no = 0;
+        writer->writeMeta("PtexVirtualMerge", &no, 1);
+    }
 
     writer->setBorderModes(ptx->vBorderMode(), ptx->uBorderMode());
 
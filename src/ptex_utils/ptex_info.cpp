@@ -5,7 +5,7 @@
 int ptex_utils::ptex_info(const char* file, PtexInfo &info, Ptex::String &err_msg)
 {
 
-    PtxPtr ptx(PtexTexture::open(file, err_msg, 0));
+    PtxPtr ptx(ptex_open(file, 0, err_msg));
     if (!ptx) {
 	return -1;
     }
@@ -1,6 +1,10 @@
 #include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 #include <numeric>
@@ -11,26 +15,69 @@
 
 #include "PtexUtils.h"
 #include "ptexutils.hpp"
+#include "convert.hpp"
+#include "digest.hpp"
+#include "topology.hpp"
 #include "helpers.hpp"
+#include "parallel.hpp"
 
 using PtexMergeOptions = ptex_utils::PtexMergeOptions;
+using PtexRemergeOptions = ptex_utils::PtexRemergeOptions;
 namespace fs = boost::filesystem;
 namespace sys = boost::system;
 
+// Face resolution reduction applied to input, see conform_res
+struct InputResize {
+    int8_t downsize = 0;
+    int8_t clamp_size = 0;
+    bool any() const { return downsize > 0 || clamp_size > 0; }
+};
+
+static
+InputResize input_resize(const PtexMergeOptions &opts, int k) {
+    InputResize r;
+    r.downsize = opts.input_downsize ? opts.input_downsize[k] : opts.downsize;
+    r.clamp_size = opts.input_clamp_size ? opts.input_clamp_size[k] : opts.clamp_size;
+    return r;
+}
+
 struct InputInfo {
     PtexMergeOptions options;
 
     int num_faces = 0;
+    size_t max_face_bytes = 0; // scratch needed by largest face
+    bool same_format = true;   // inputs have output data type and channels
+    bool mipmaps = true;       // output stores reductions
+    bool inputs_mipmaps = true; // all inputs store reductions
 
     bool merge_mesh = true;
     obj_mesh mesh;
 
-    std::vector<PtxPtr> ptexes;
+    std::vector<std::string> paths;
+    std::vector<PtxPtr> ptexes; // null if input is not open
+    std::vector<int32_t> face_counts;
     std::vector<int32_t> offsets;
     std::vector<int32_t> mesh_offsets;
-    void add(int32_t offset, int32_t mesh_offset, PtxPtr & p) {
+    std::vector<InputResize> resizes;
+
+    // Sources written to PtexMergedFiles meta, same as inputs unless
+    // some of inputs are merged files
+    std::vector<fs::path> sources;
+    std::vector<int32_t> source_offsets;
+    std::vector<int32_t> source_mesh_offsets;
+    std::vector<int32_t> source_vert_offsets; // first vertex in merged mesh
+    bool vert_offsets = true; // false if some of them are unknown
+    std::vector<InputResize> source_resizes;
+    std::vector<uint64_t> source_digests;
+    std::vector<uint64_t> source_topologies; // 0 if unknown
+
+    void add(const std::string &path, int32_t offset, int32_t mesh_offset,
+             int32_t nfaces, PtxPtr & p, InputResize resize = InputResize()) {
+        paths.push_back(path);
+        resizes.push_back(resize);
         offsets.push_back(offset);
         mesh_offsets.push_back(mesh_offset);
+        face_counts.push_back(nfaces);
         ptexes.emplace_back(std::move(p));
     }
 };
@@ -91,154 +138,588 @@ int check_ptx(const PtexMergeOptions &info,
     return 0;
 }
 
+// What merge needs to know about input before writing its faces
+struct InputScan {
+    PtxPtr ptex;
+    int num_faces = 0;
+    int64_t texels = 0;
+    int64_t constant_faces = 0;
+    size_t max_face_bytes = 0; // buffers needed to convert largest face
+    size_t pixel_size = 0;
+    uint64_t file_size = 0;
+    uint64_t topology = 0;
+    bool same_format = true;
+};
+
+// Reads header and face infos of input, safe to call from several threads
 static
-int append_input(InputInfo &info, const char* filename, Ptex::String &err_msg) {
-    PtxPtr ptex(PtexTexture::open(filename, err_msg, 0));
+int scan_input(const PtexMergeOptions &options, const char* filename,
+               InputResize resize, InputScan &scan, Ptex::String &err_msg) {
+    scan.ptex.reset(ptex_utils::ptex_open(filename, 0, err_msg));
+    PtexTexture *ptex = scan.ptex.get();
     if (!ptex) {
         err_msg = std::string("Opening input file: ") + filename +
             ":" + std::string(err_msg.c_str());
 	return -1;
     }
-    if (check_ptx(info.options, ptex.get(), err_msg))
+    if (check_ptx(options, ptex, err_msg))
         return -1;
-    int mesh_offset = 0;
+
+    scan.num_faces = ptex->numFaces();
+    int max_texels = 0;
+    for (int i = 0; i < scan.num_faces; ++i) {
+        const Ptex::FaceInfo &f = ptex->getFaceInfo(i);
+        if (f.isConstant()) {
+            scan.texels += 1;
+            scan.constant_faces += 1;
+        }
+        else {
+            int size = conform_res(f, resize.downsize, resize.clamp_size).size();
+            scan.texels += size;
+            max_texels = std::max(max_texels, size);
+        }
+    }
+    // Scratch in input format is needed only for faces read reduced
+    size_t pixel_size = Ptex::DataSize(options.data_type) * options.num_channels;
+    if (resize.any())
+        pixel_size += Ptex::DataSize(ptex->dataType()) * ptex->numChannels();
+    scan.max_face_bytes = pixel_size * max_texels;
+    scan.pixel_size = Ptex::DataSize(ptex->dataType()) * ptex->numChannels();
+    scan.same_format = ptex->dataType() == options.data_type
+        && ptex->numChannels() == options.num_channels;
+    scan.topology = texture_topology(ptex);
+    return 0;
+}
+
+static
+fs::path strip_prefix(const fs::path & path, const fs::path &prefix)
+{
+    auto i = std::begin(path);
+    auto iend = std::end(path);
+    auto p = std::begin(prefix);
+    auto pend = std::end(prefix);
+    for (; i != iend && p != pend; ++i, ++p)
+    {
+        if (*i == *p)
+            continue;
+        else
+            break;
+    }
+    if (p != pend)
+        return path;
+
+    fs::path res;
+    for (; i != iend; ++i)
+        res /= *i;
+    return res;
+}
+
+// Records sources of merged input instead of input itself. Their names are
+// looked up under root first, then next to input. Returns false if input
+// is not a merged file or some of its sources can't be found.
+static
+bool flatten_merged(InputInfo &info, PtexTexture *ptex, const fs::path &filename,
+                    const fs::path &root, int32_t offset, int32_t mesh_offset,
+                    int32_t vert_offset, InputResize resize) {
+    MetaPtr meta(ptex->getMetaData());
+    const char *filenames = 0;
+    meta->getValue("PtexMergedFiles", filenames);
+    if (!filenames)
+        return false;
+    const int32_t *offsets = 0;
+    int noffsets = 0;
+    meta->getValue("PtexMergedOffsets", offsets, noffsets);
+    if (!offsets)
+        return false;
+    const int32_t *mesh_offsets = 0;
+    int nmesh_offsets = 0;
+    meta->getValue("PtexMergedMeshOffsets", mesh_offsets, nmesh_offsets);
+    const int32_t *vert_offsets = 0;
+    int nvert_offsets = 0;
+    meta->getValue("PtexMergedVertOffsets", vert_offsets, nvert_offsets);
+    const int8_t *downsizes = 0, *clamp_sizes = 0;
+    int ndownsizes = 0, nclamp_sizes = 0;
+    meta->getValue("PtexMergedDownsize", downsizes, ndownsizes);
+    meta->getValue("PtexMergedClampSize", clamp_sizes, nclamp_sizes);
+    std::vector<uint64_t> topologies;
+    read_uint64_meta(meta.get(), "PtexMergedTopology", topologies);
+
+    std::vector<std::string> names;
+    split_names(filenames, names);
+    if ((size_t) noffsets != names.size())
+        return false;
+    if (nmesh_offsets != noffsets)
+        mesh_offsets = 0;
+    if (nvert_offsets != noffsets)
+        vert_offsets = 0;
+    if (ndownsizes != noffsets || nclamp_sizes != noffsets)
+        downsizes = clamp_sizes = 0;
+    if (topologies.size() != names.size())
+        topologies.assign(names.size(), 0);
+    // Sources reduced twice can't be described by one resize
+    if (downsizes && resize.any())
+        return false;
+
+    fs::path dir = filename.parent_path();
+    std::vector<fs::path> paths;
+    sys::error_code ec;
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (offsets[i] < 0 || offsets[i] > ptex->numFaces())
+            return false;
+        fs::path p = fs::absolute(names[i], root);
+        if (!fs::exists(p, ec))
+            p = fs::absolute(names[i], dir);
+        if (!fs::exists(p, ec))
+            return false;
+        paths.push_back(p);
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+        info.sources.push_back(paths[i]);
+        info.source_offsets.push_back(offset + offsets[i]);
+        info.source_mesh_offsets.push_back(mesh_offset + (mesh_offsets ? mesh_offsets[i] : 0));
+        info.source_vert_offsets.push_back(vert_offset + (vert_offsets ? vert_offsets[i] : 0));
+        if (downsizes) {
+            resize.downsize = downsizes[i];
+            resize.clamp_size = clamp_sizes[i];
+        }
+        info.source_resizes.push_back(resize);
+        info.source_topologies.push_back(topologies[i]);
+    }
+    info.vert_offsets = info.vert_offsets && (vert_offsets || names.size() == 1);
+    return true;
+}
+
+static
+bool is_virtual(PtexTexture *ptex) {
+    MetaPtr meta(ptex->getMetaData());
+    const int8_t *marker = 0;
+    int count = 0;
+    meta->getValue("PtexVirtualMerge", marker, count);
+    return marker && count == 1 && marker[0];
+}
+
+// Input already scanned by scan_inputs is only reopened if scan released it
+static
+int append_input(InputInfo &info, const fs::path &filename, const fs::path &root,
+                 InputScan *scanned, Ptex::String &err_msg) {
+    InputScan own;
+    InputScan &scan = scanned ? *scanned : own;
+    InputResize resize = input_resize(info.options, info.paths.size());
+    if (!scanned) {
+        if (scan_input(info.options, filename.string().c_str(), resize, scan, err_msg))
+            return -1;
+    }
+    else if (!scan.ptex) {
+        scan.ptex.reset(ptex_utils::ptex_open(filename.string().c_str(), 0, err_msg));
+        if (!scan.ptex) {
+            err_msg = "Opening input file: " + filename.string() +
+                ":" + std::string(err_msg.c_str());
+            return -1;
+        }
+    }
+    int mesh_offset = 0, vert_offset = 0;
     if (info.merge_mesh) {
         mesh_offset = info.mesh.nverts.size();
-        int nfaces = append_mesh(info.mesh, ptex.get());
+        vert_offset = info.mesh.pos.size() / 3;
+        int nfaces = append_mesh(info.mesh, scan.ptex.get());
         info.options.merge_mesh = nfaces > 0;
     }
 
-    int nf = ptex->numFaces();
-    info.add(info.num_faces, mesh_offset, ptex);
-    info.num_faces += nf;
+    info.same_format = info.same_format && scan.same_format;
+    info.inputs_mipmaps = info.inputs_mipmaps && scan.ptex->hasMipMaps();
+    info.max_face_bytes = std::max(info.max_face_bytes, scan.max_face_bytes);
+    // Virtual merge reads faces from inputs, only virtual inputs can be
+    // replaced by their sources then
+    bool flatten = info.options.flatten_merged &&
+        (!info.options.virtual_merge || is_virtual(scan.ptex.get()));
+    if (!flatten ||
+        !flatten_merged(info, scan.ptex.get(), filename, root, info.num_faces, mesh_offset,
+                        vert_offset, resize)) {
+        info.sources.push_back(filename);
+        info.source_offsets.push_back(info.num_faces);
+        info.source_mesh_offsets.push_back(mesh_offset);
+        info.source_vert_offsets.push_back(vert_offset);
+        info.source_resizes.push_back(resize);
+        info.source_topologies.push_back(scan.topology);
+    }
+    // Streaming merge reopens input when its faces are written
+    if (info.options.max_open_files > 0)
+        scan.ptex.reset();
+    info.add(filename.string(), info.num_faces, mesh_offset, scan.num_faces, scan.ptex,
+             resize);
+    info.num_faces += scan.num_faces;
+
+    return 0;
+}
 
+static
+int open_input(InputInfo &info, int k, Ptex::String &err_msg) {
+    const char *filename = info.paths[k].c_str();
+    PtxPtr ptex(ptex_utils::ptex_open(filename, 0, err_msg));
+    if (!ptex) {
+        err_msg = std::string("Opening input file: ") + filename +
+            ":" + std::string(err_msg.c_str());
+	return -1;
+    }
+    if (check_ptx(info.options, ptex.get(), err_msg))
+        return -1;
+    if (ptex->numFaces() != info.face_counts[k]) {
+        err_msg = std::string("Input file changed during merge: ") + filename;
+        return -1;
+    }
+    info.ptexes[k] = std::move(ptex);
     return 0;
 }
 
+struct MergeFace {
+    int face_id = 0;
+    Ptex::FaceInfo info;
+    std::vector<char> data;
+    FaceDataPtr raw; // reader owned face data, used instead of data if set
+};
+
+// Scratch buffer owned by one merge thread
+struct FaceScratch {
+    std::vector<char> data;
+};
+
+template <typename T>
+static
+void grow(std::vector<T> &v, size_t size) {
+    if (v.size() < size)
+        v.resize(size);
+}
+
+// Face info of input face with adjacency in merged face ids
 static
-int append_ptexture(const PtexMergeOptions &info,
-                    PtexWriter *writer,
-                    const int offset,
-                    PtexTexture *ptex) {
+Ptex::FaceInfo merged_face_info(PtexTexture *ptex, const int offset, const int i) {
+    Ptex::FaceInfo outf = ptex->getFaceInfo(i);
+    outf.adjfaces[0] = outf.adjfaces[0] == -1 ? -1 : outf.adjfaces[0] + offset;
+    outf.adjfaces[1] = outf.adjfaces[1] == -1 ? -1 : outf.adjfaces[1] + offset;
+    outf.adjfaces[2] = outf.adjfaces[2] == -1 ? -1 : outf.adjfaces[2] + offset;
+    outf.adjfaces[3] = outf.adjfaces[3] == -1 ? -1 : outf.adjfaces[3] + offset;
+    return outf;
+}
+
+static
+void read_face(const PtexMergeOptions &info,
+               PtexTexture *ptex,
+               const int offset,
+               const int i,
+               InputResize resize,
+               FaceScratch &scratch,
+               MergeFace &out) {
 
-    const int num_faces = ptex->numFaces();
     const int nchannels = ptex->numChannels();
     const Ptex::DataType data_type = ptex->dataType();
 
     const int data_pixel_size = Ptex::DataSize(data_type) * nchannels;
-    const int stripped_pixel_size = Ptex::DataSize(data_type) * info.num_channels;
     const int out_pixel_size = Ptex::DataSize(info.data_type)*info.num_channels;
 
-    std::vector<char> data;
-    data.resize(data_pixel_size*1024);
-
     const bool strip_chans = nchannels > info.num_channels;
 
-    const bool do_convert = info.data_type != ptex->dataType();
+    const bool do_convert = info.data_type != data_type;
+
+    Ptex::FaceInfo outf = merged_face_info(ptex, offset, i);
+    const bool reduce = resize.any() && outf.res != conform_res(outf, resize.downsize,
+                                                                 resize.clamp_size);
+    if (reduce)
+        outf.res = conform_res(outf, resize.downsize, resize.clamp_size);
 
-    std::vector<float> fdata;
-    std::vector<char> odata;
+    out.face_id = offset+i;
+    out.info = outf;
 
-    if (do_convert) {
-        fdata.resize(info.num_channels*1024);
-        odata.resize(out_pixel_size*1024);
+    // Only value of constant face is read, buffers never grow to its
+    // resolution
+    const bool constant = outf.isConstant();
+    const Ptex::Res res = constant ? Ptex::Res(0, 0) : outf.res;
+    const int npixels = res.size();
+
+    // Same format, hand reader's face buffer to writer without copying.
+    // Memory bound counts only merge buffers, so faces are copied then.
+    if (!strip_chans && !do_convert && !reduce && !constant && !info.max_memory) {
+        FaceDataPtr face(ptex->getData(i));
+        if (face && !face->isTiled() && face->getData()) {
+            out.raw = std::move(face);
+            return;
+        }
     }
 
-    for (int i = 0; i < num_faces; ++i) {
-	Ptex::FaceInfo outf = ptex->getFaceInfo(i);
-	outf.adjfaces[0] = outf.adjfaces[0] == -1 ? -1 : outf.adjfaces[0] + offset;
-	outf.adjfaces[1] = outf.adjfaces[1] == -1 ? -1 : outf.adjfaces[1] + offset;
-	outf.adjfaces[2] = outf.adjfaces[2] == -1 ? -1 : outf.adjfaces[2] + offset;
-	outf.adjfaces[3] = outf.adjfaces[3] == -1 ? -1 : outf.adjfaces[3] + offset;
+    // Faces at full resolution are converted tile by tile
+    if (!reduce && !constant) {
+        grow(out.data, npixels*out_pixel_size);
+        if (read_face_tiles(ptex, i, out.data.data(), info.data_type, info.num_channels))
+            return;
+    }
 
-	size_t req_size = outf.res.size()*data_pixel_size;
-	if (req_size > data.size()){
-	    data.resize(req_size);
-            if (do_convert) {
-                fdata.resize(outf.res.size()*info.num_channels);
-                odata.resize(outf.res.size()*out_pixel_size);
-            }
-	}
-        // This is slow and bad
-        ptex->getData(i, data.data(), 0);
-        if (strip_chans && !outf.isConstant()) {
-            char *dst = data.data()+stripped_pixel_size;
-            char *src = data.data()+data_pixel_size;
-            char *end = data.data()+stripped_pixel_size*outf.res.size();
-            while (dst != end) {
-                std::memmove(dst, src, stripped_pixel_size);
-                dst += stripped_pixel_size;
-                src += data_pixel_size;
+    if (!strip_chans && !do_convert) {
+        grow(out.data, npixels*data_pixel_size);
+        ptex->getData(i, out.data.data(), 0, res);
+        return;
+    }
+    grow(scratch.data, npixels*data_pixel_size);
+    grow(out.data, npixels*out_pixel_size);
+    ptex->getData(i, scratch.data.data(), 0, res);
+    convert_pixels(out.data.data(), info.data_type,
+                   scratch.data.data(), data_type, nchannels,
+                   info.num_channels, npixels);
+}
+
+static
+void write_face(PtexWriter *writer, MergeFace &face) {
+    const void *data = face.raw ? face.raw->getData() : face.data.data();
+    if (face.info.isConstant())
+        writer->writeConstantFace(face.face_id, face.info, data);
+    else
+        writer->writeFace(face.face_id, face.info, data, 0);
+    face.raw.reset();
+}
+
+// Number of face decoding threads and faces in flight for merge. Fails
+// if buffers of largest face alone are over max_memory.
+static
+int pipeline_size(const PtexMergeOptions &opts, int nfaces, size_t max_face_bytes,
+                  int &nthreads, int &nslots, Ptex::String &err_msg) {
+    nthreads = std::min(resolve_threads(opts.num_threads), std::max(nfaces, 1));
+    nslots = nthreads > 1 ? nthreads*4 : 1;
+    if (opts.max_memory > 0 && max_face_bytes > 0) {
+        // Each thread needs scratch and each slot holds converted face
+        size_t fit = opts.max_memory / max_face_bytes / 2;
+        if (fit == 0) {
+            err_msg = "Largest face needs " + std::to_string(2 * max_face_bytes) +
+                " bytes of buffers, more than max memory " +
+                std::to_string(opts.max_memory);
+            return -1;
+        }
+        nslots = std::min<size_t>(nslots, fit);
+        nthreads = std::min(nthreads, nslots);
+    }
+    if (nthreads <= 1)
+        nslots = 1;
+    return 0;
+}
+
+// Appends faces of selected inputs to writer. Faces are decoded and
+// converted on options.num_threads threads and written in face id order,
+// so output does not depend on number of threads. Inputs which are not
+// open are opened at most options.max_open_files at a time and released
+// when written.
+static
+int append_inputs(const PtexMergeOptions &opts,
+                  InputInfo &info,
+                  const std::vector<int> &inputs,
+                  PtexWriter *writer,
+                  Ptex::String &err_msg) {
+
+    std::vector<int> starts(1, 0);
+    for (int k : inputs)
+        starts.push_back(starts.back() + info.face_counts[k]);
+    const int nfaces = starts.back();
+
+    int nthreads, nslots;
+    if (pipeline_size(opts, nfaces, info.max_face_bytes, nthreads, nslots, err_msg))
+        return -1;
+    std::vector<FaceScratch> scratch(nthreads);
+    std::vector<MergeFace> slots(nslots);
+
+    size_t next_input = 0;
+    auto notify = [&](int face) -> int {
+        for (; next_input < inputs.size() && starts[next_input] <= face; ++next_input) {
+            if (opts.callback && opts.callback(inputs[next_input], opts.callback_data)) {
+                err_msg = "Interrupted";
+                return -1;
             }
         }
-        if (do_convert) {
-            Ptex::ConvertToFloat(fdata.data(), data.data(), data_type,
-                                 info.num_channels*outf.res.size());
-            Ptex::ConvertFromFloat(odata.data(), fdata.data(),
-                                   info.data_type, info.num_channels*outf.res.size());
-            if (outf.isConstant())
-                writer->writeConstantFace(offset+i, outf, odata.data());
-            else
-                writer->writeFace(offset+i, outf, odata.data(), 0);
+        return 0;
+    };
+
+    auto produce = [&](int worker, int i, MergeFace &face) -> int {
+        size_t j = std::upper_bound(begin(starts), end(starts), i) - begin(starts) - 1;
+        int k = inputs[j];
+        read_face(info.options, info.ptexes[k].get(), info.offsets[k], i - starts[j],
+                  info.resizes[k],
+                  scratch[worker], face);
+        return 0;
+    };
+
+    const size_t window = opts.max_open_files > 0 ? opts.max_open_files : inputs.size();
+    for (size_t first = 0; first < inputs.size(); first += window) {
+        const size_t last = std::min(first + window, inputs.size());
+        std::vector<int> opened;
+        for (size_t j = first; j < last; ++j) {
+            int k = inputs[j];
+            if (info.ptexes[k])
+                continue;
+            if (open_input(info, k, err_msg))
+                return -1;
+            opened.push_back(k);
         }
-        else {
-            if (outf.isConstant())
-                writer->writeConstantFace(offset+i, outf, data.data());
-            else
-                writer->writeFace(offset+i, outf, data.data());
+
+        auto consume = [&](int i, MergeFace &face) -> int {
+            if (notify(starts[first] + i))
+                return -1;
+            if (opts.stats) {
+                opts.stats->faces += 1;
+                opts.stats->texels += face.info.res.size();
+            }
+            write_face(writer, face);
+            return 0;
+        };
+        auto produce_window = [&](int worker, int i, MergeFace &face) -> int {
+            return produce(worker, starts[first] + i, face);
+        };
+        if (ordered_pipeline(starts[last] - starts[first], nthreads, slots,
+                             produce_window, consume))
+            return -1;
+
+        for (int k : opened)
+            info.ptexes[k].reset();
+    }
+    return notify(nfaces);
+}
+
+// Writes face infos of inputs as zero constant faces of virtual merge
+// index, texels stay in inputs.
+static
+int append_index(const PtexMergeOptions &opts,
+                 InputInfo &info,
+                 PtexWriter *writer,
+                 Ptex::String &err_msg) {
+    std::vector<char> zero(Ptex::DataSize(opts.data_type) * opts.num_channels, 0);
+    for (size_t k = 0; k < info.paths.size(); ++k) {
+        if (opts.callback && opts.callback(k, opts.callback_data)) {
+            err_msg = "Interrupted";
+            return -1;
+        }
+        bool opened = !info.ptexes[k];
+        if (opened && open_input(info, k, err_msg))
+            return -1;
+        PtexTexture *ptex = info.ptexes[k].get();
+        for (int i = 0; i < info.face_counts[k]; ++i) {
+            Ptex::FaceInfo f = merged_face_info(ptex, info.offsets[k], i);
+            writer->writeConstantFace(info.offsets[k] + i, f, zero.data());
         }
+        if (opened)
+            info.ptexes[k].reset();
     }
     return 0;
 }
 
+int ptex_utils::ptex_merge_options(const char* file,
+                                   PtexMergeOptions &options,
+                                   Ptex::String &err_msg)
+{
+    PtxPtr first(PtexTexture::open(file, err_msg, 0));
+    if (!first) {
+        err_msg = std::string(file) + ":"+ std::string(err_msg.c_str());
+        return -1;
+    }
+    options.data_type = first->dataType();
+    options.mesh_type = first->meshType();
+    options.num_channels = first->numChannels();
+    options.alpha_channel = first->alphaChannel();
+
+    options.u_border_mode = first->uBorderMode();
+    options.v_border_mode = first->vBorderMode();
+    return 0;
+}
 
 int ptex_utils::ptex_merge(int nfiles, const char** files,
                            const char*output_file, int *offsets,
                            Ptex::String &err_msg)
 {
     PtexMergeOptions options;
-    if (nfiles > 0) {
-        PtxPtr first(PtexTexture::open(files[0], err_msg, 0));
-        if (!first) {
-            err_msg = std::string(files[0]) + ":"+ std::string(err_msg.c_str());
-            return -1;
-        }
-        options.data_type = first->dataType();
-        options.mesh_type = first->meshType();
-        options.num_channels = first->numChannels();
-        options.alpha_channel = first->alphaChannel();
-
-        options.u_border_mode = first->uBorderMode();
-        options.v_border_mode = first->vBorderMode();
-    }
+    if (nfiles > 0 && ptex_merge_options(files[0], options, err_msg))
+        return -1;
     return ptex_utils::ptex_merge(options, nfiles, files, output_file,
                                   offsets, err_msg);
 
 }
 
+// Scans inputs on opts.num_threads threads and releases them unless
+// keep_open is set
 static
-fs::path strip_prefix(const fs::path & path, const fs::path &prefix)
+int scan_inputs(const PtexMergeOptions &opts,
+                int nfiles, const char** files,
+                std::vector<InputScan> &scans,
+                Ptex::String &err_msg, bool keep_open = false)
 {
-    auto i = std::begin(path);
-    auto iend = std::end(path);
-    auto p = std::begin(prefix);
-    auto pend = std::end(prefix);
-    for (; i != iend && p != pend; ++i, ++p)
-    {
-        if (*i == *p)
-            continue;
-        else
-            break;
+    fs::path root = fs::absolute(opts.root ? fs::path(opts.root) : fs::current_path());
+
+    scans.resize(nfiles);
+    std::vector<Ptex::String> errors(nfiles);
+    std::vector<char> failed(nfiles, 0);
+    parallel_for(nfiles, opts.num_threads, [&](int i) {
+            std::string path = fs::absolute(files[i], root).string();
+            if (scan_input(opts, path.c_str(), input_resize(opts, i), scans[i], errors[i])) {
+                failed[i] = 1;
+                return;
+            }
+            if (!keep_open)
+                scans[i].ptex.reset();
+            sys::error_code ec;
+            scans[i].file_size = fs::file_size(path, ec);
+            if (ec)
+                scans[i].file_size = 0;
+        });
+    for (int i = 0; i < nfiles; ++i) {
+        if (failed[i]) {
+            err_msg = errors[i];
+            return -1;
+        }
     }
-    if (p != pend)
-        return path;
+    return 0;
+}
 
-    fs::path res;
-    for (; i != iend; ++i)
-        res /= *i;
-    return res;
+int ptex_utils::ptex_merge_plan(const PtexMergeOptions &opts,
+                                int nfiles, const char** files,
+                                int *offsets, PtexMergePlan &plan,
+                                Ptex::String &err_msg)
+{
+    if (nfiles < 1){
+	err_msg = "At least one file required";
+	return -1;
+    }
+    std::vector<InputScan> scans;
+    if (scan_inputs(opts, nfiles, files, scans, err_msg))
+        return -1;
+
+    plan = PtexMergePlan();
+    const size_t out_pixel_size = Ptex::DataSize(opts.data_type) * opts.num_channels;
+    size_t max_face_bytes = 0;
+    bool same_format = true;
+    double compressed = 0;
+    for (int i = 0; i < nfiles; ++i) {
+        const InputScan &scan = scans[i];
+        if (offsets)
+            offsets[i] = plan.num_faces;
+        plan.num_faces += scan.num_faces;
+        plan.texels += scan.texels;
+        plan.constant_faces += scan.constant_faces;
+        max_face_bytes = std::max(max_face_bytes, scan.max_face_bytes);
+        same_format = same_format && scan.same_format;
+        // Compressed size is assumed to scale with pixel size
+        compressed += double(scan.file_size) * out_pixel_size / scan.pixel_size;
+    }
+    plan.data_bytes = plan.texels * out_pixel_size;
+    plan.output_bytes = compressed;
+    if (!same_format || !opts.skip_mipmaps) {
+        // Reductions add up to one third of full resolution data
+        plan.output_bytes += compressed / 3;
+    }
+
+    int nthreads, nslots;
+    if (pipeline_size(opts, plan.num_faces, max_face_bytes, nthreads, nslots, err_msg))
+        return -1;
+    const int nopen = opts.max_open_files > 0 ? std::min(opts.max_open_files, nfiles) : nfiles;
+    plan.max_open_files = nopen;
+    // Face buffers, writer's face table and constant data
+    plan.peak_memory = (nthreads + nslots) * max_face_bytes
+        + plan.num_faces * (sizeof(Ptex::FaceInfo) + out_pixel_size);
+    return 0;
 }
 
+
 static
 void write_meta_block(PtexWriter *writer, ptex_utils::PtexMeta *meta)
 {
@@ -271,10 +752,23 @@ void write_meta_block(PtexWriter *writer, ptex_utils::PtexMeta *meta)
 
 }
 
-int ptex_utils::ptex_merge(const PtexMergeOptions & opts,
-                           int nfiles, const char** files,
-                           const char*output_file, int *offsets,
-                           Ptex::String &err_msg){
+// Content digests of files, 0 for files that can't be read
+static
+void file_digests(const std::vector<std::string> &paths, int nthreads,
+                  std::vector<uint64_t> &digests) {
+    digests.assign(paths.size(), 0);
+    parallel_for(paths.size(), nthreads, [&](int i) {
+            if (!file_digest(paths[i].c_str(), digests[i]))
+                digests[i] = 0;
+        });
+}
+
+// Merges files, scans of them are reused if given
+static
+int merge_inputs(const PtexMergeOptions & opts,
+                 int nfiles, const char** files,
+                 const char*output_file, int *offsets,
+                 InputScan *scans, Ptex::String &err_msg){
 
     InputInfo info;
     info.options = opts;
@@ -300,32 +794,52 @@ int ptex_utils::ptex_merge(const PtexMergeOptions & opts,
     }
 
     for (int i = 0; i < nfiles; i++){
-	if (append_input(info, filepaths[i].string().c_str(), err_msg))
+	if (append_input(info, filepaths[i], root, scans ? &scans[i] : 0, err_msg))
 	    return -1;
     }
 
+    if (opts.virtual_merge && !info.same_format) {
+        err_msg = "Virtual merge needs all inputs in output data type and channel count";
+        return -1;
+    }
+    if (opts.virtual_merge && std::any_of(begin(info.resizes), end(info.resizes),
+                                          [](InputResize r) { return r.any(); })) {
+        err_msg = "Virtual merge can't reduce face resolution";
+        return -1;
+    }
+
+    // Reductions of same format inputs are left for readers to build
+    info.mipmaps = !(opts.skip_mipmaps && info.same_format) && !opts.virtual_merge;
     WriterPtr writer(PtexWriter::open(output_file,
                                       info.options.mesh_type,
                                       info.options.data_type,
                                       info.options.num_channels,
                                       info.options.alpha_channel,
                                       info.num_faces,
-                                      err_msg));
+                                      err_msg,
+                                      info.mipmaps));
     if (!writer) {
         err_msg = "Can't open for writing " + std::string(output_file) + ":" + err_msg;
 	return -1;
     }
-    for (int i = 0; i < nfiles; ++i)
-    {
-        if (opts.callback) {
-            bool stop = opts.callback(i, opts.callback_data);
-            if (stop) {
-                err_msg = "Interrupted";
-                return -1;
-            }
-        }
-	if(append_ptexture(info.options, writer.get(), info.offsets[i], info.ptexes[i].get()))
-           return -1;
+    std::vector<int> inputs(nfiles);
+    std::iota(begin(inputs), end(inputs), 0);
+    auto start_time = std::chrono::steady_clock::now();
+    if (opts.virtual_merge) {
+        if (append_index(opts, info, writer.get(), err_msg))
+            return -1;
+        // Readers reduce faces of inputs, which have mip maps if all
+        // inputs have them
+        int8_t marker = 1;
+        int8_t mipmaps = info.inputs_mipmaps;
+        writer->writeMeta("PtexVirtualMerge", &marker, 1);
+        writer->writeMeta("PtexVirtualMipMaps", &mipmaps, 1);
+    }
+    else if (append_inputs(opts, info, inputs, writer.get(), err_msg))
+        return -1;
+    if (opts.stats) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        opts.stats->seconds += elapsed.count();
     }
 
     if (offsets) {
@@ -342,12 +856,17 @@ int ptex_utils::ptex_merge(const PtexMergeOptions & opts,
         writer->writeMeta("PtexVertPositions",
                           info.mesh.pos.data(),
                           info.mesh.pos.size());
+        write_topology(writer.get(), info.mesh.nverts.size(),
+                       info.mesh.nverts.data(), info.mesh.verts.data());
     }
 
+    // Readers of virtual merge look sources up next to index, sources
+    // outside its directory are kept absolute
+    const fs::path names_root = opts.virtual_merge ? outpath.parent_path() : root;
     std::vector<std::string> names;
-    std::transform(std::begin(filepaths), std::end(filepaths),std::back_inserter(names),
+    std::transform(std::begin(info.sources), std::end(info.sources), std::back_inserter(names),
                    [&](const fs::path p) {
-                       return strip_prefix(p, root).string();
+                       return strip_prefix(p, names_root).string();
                    });
     size_t joined_size = std::accumulate(begin(names), end(names), 0,
                                          [](size_t acc, const std::string &s) {
@@ -362,12 +881,40 @@ int ptex_utils::ptex_merge(const PtexMergeOptions & opts,
         joined.append(*it);
     }
     writer->writeMeta("PtexMergedFiles", joined.c_str());
-    writer->writeMeta("PtexMergedOffsets", info.offsets.data(), info.offsets.size());
+    writer->writeMeta("PtexMergedOffsets",
+                      info.source_offsets.data(), info.source_offsets.size());
     if (info.merge_mesh) {
         writer->writeMeta("PtexMergedMeshOffsets",
-                          info.mesh_offsets.data(),
-                          info.mesh_offsets.size());
+                          info.source_mesh_offsets.data(),
+                          info.source_mesh_offsets.size());
+        // Split copies vertices of sources between these whole, including
+        // ones their faces do not reference
+        if (info.vert_offsets)
+            writer->writeMeta("PtexMergedVertOffsets",
+                              info.source_vert_offsets.data(),
+                              info.source_vert_offsets.size());
     }
+    if (std::any_of(begin(info.source_resizes), end(info.source_resizes),
+                    [](InputResize r) { return r.any(); })) {
+        std::vector<int8_t> downsizes, clamp_sizes;
+        for (const InputResize &r : info.source_resizes) {
+            downsizes.push_back(r.downsize);
+            clamp_sizes.push_back(r.clamp_size);
+        }
+        writer->writeMeta("PtexMergedDownsize", downsizes.data(), downsizes.size());
+        writer->writeMeta("PtexMergedClampSize", clamp_sizes.data(), clamp_sizes.size());
+    }
+    std::vector<std::string> paths;
+    for (const fs::path &p : info.sources)
+        paths.push_back(p.string());
+    if (opts.digests && !opts.virtual_merge) {
+        file_digests(paths, opts.num_threads, info.source_digests);
+        write_uint64_meta(writer.get(), "PtexMergedDigests", info.source_digests);
+    }
+    // Remerge rejects sources whose topology differs from one recorded here
+    if (std::any_of(begin(info.source_topologies), end(info.source_topologies),
+                    [](uint64_t t) { return t != 0; }))
+        write_uint64_meta(writer.get(), "PtexMergedTopology", info.source_topologies);
     if (opts.meta)
         write_meta_block(writer.get(), opts.meta);
     if (!writer->close(err_msg)){
@@ -377,23 +924,168 @@ int ptex_utils::ptex_merge(const PtexMergeOptions & opts,
     return 0;
 }
 
+int ptex_utils::ptex_merge(const PtexMergeOptions & opts,
+                           int nfiles, const char** files,
+                           const char*output_file, int *offsets,
+                           Ptex::String &err_msg)
+{
+    return merge_inputs(opts, nfiles, files, output_file, offsets, 0, err_msg);
+}
+
+// Forwards progress of one shard to user callback with global input index
+struct ShardCallback {
+    const PtexMergeOptions *opts;
+    const int *inputs;
+    std::mutex *lock;
+};
+
 static
-void split_names(const char* str, std::vector<std::string> &names) {
-    const char* end;
-    end = std::strchr(str, ':');
-    while (str[0] && end) {
-        names.emplace_back(str, end-str);
-        str = end+1;
-        end = std::strchr(str, ':');
+bool shard_callback(int i, void *data) {
+    ShardCallback *cb = static_cast<ShardCallback*>(data);
+    std::lock_guard<std::mutex> guard(*cb->lock);
+    return cb->opts->callback(cb->inputs[i], cb->opts->callback_data);
+}
+
+static
+fs::path shard_path(const fs::path &output, int shard)
+{
+    fs::path name = output.stem();
+    name += "." + std::to_string(shard);
+    name += output.extension();
+    return output.parent_path() / name;
+}
+
+int ptex_utils::ptex_merge_sharded(const PtexMergeOptions &opts,
+                                   const PtexShardBudget &budget,
+                                   int nfiles, const char** files,
+                                   const char* output_file,
+                                   int *shards, int *offsets, int &nshards,
+                                   Ptex::String &err_msg)
+{
+    if (nfiles < 1){
+	err_msg = "At least one file required";
+	return -1;
+    }
+    if (output_file == 0){
+	err_msg = "Output file is null";
+	return -1;
+    }
+
+    // Shard merges reuse scans, inputs stay open unless merge streams them
+    std::vector<InputScan> scans;
+    if (scan_inputs(opts, nfiles, files, scans, err_msg, opts.max_open_files <= 0))
+        return -1;
+
+    // Pack inputs in order, next shard starts when any budget is exceeded
+    const size_t out_pixel_size = Ptex::DataSize(opts.data_type) * opts.num_channels;
+    std::vector<int> first_input(1, 0);
+    std::vector<int> input_shard(nfiles), input_offset(nfiles);
+    int64_t faces = 0, texels = 0;
+    for (int i = 0; i < nfiles; ++i) {
+        const InputScan &scan = scans[i];
+        bool over = (budget.faces > 0 && faces + scan.num_faces > budget.faces)
+            || (budget.texels > 0 && texels + scan.texels > budget.texels)
+            || (budget.bytes > 0
+                && (texels + scan.texels) * (int64_t) out_pixel_size > budget.bytes);
+        if (over && i > first_input.back()) {
+            first_input.push_back(i);
+            faces = texels = 0;
+        }
+        input_shard[i] = first_input.size()-1;
+        input_offset[i] = faces;
+        faces += scan.num_faces;
+        texels += scan.texels;
+    }
+    nshards = first_input.size();
+    first_input.push_back(nfiles);
+
+    // Shards are merged concurrently and share threads between them
+    const int nthreads = resolve_threads(opts.num_threads);
+    const int concurrent = std::min(nthreads, nshards);
+    PtexMergeOptions shard_opts = opts;
+    shard_opts.num_threads = std::max(1, nthreads / concurrent);
+    if (opts.max_open_files > 0)
+        shard_opts.max_open_files = std::max(1, opts.max_open_files / concurrent);
+    if (opts.max_memory > 0)
+        shard_opts.max_memory = opts.max_memory / concurrent;
+
+    const fs::path root = fs::absolute(opts.root ? fs::path(opts.root) : fs::current_path());
+    const fs::path output = fs::absolute(output_file, root);
+
+    std::mutex callback_lock;
+    std::vector<Ptex::String> errors(nshards);
+    std::vector<char> failed(nshards, 0);
+    std::vector<int> shard_inputs(nfiles);
+    std::iota(begin(shard_inputs), end(shard_inputs), 0);
+    parallel_for(nshards, concurrent, [&](int shard) {
+            const int first = first_input[shard];
+            const int count = first_input[shard+1] - first;
+            PtexMergeOptions o = shard_opts;
+            if (opts.input_downsize)
+                o.input_downsize = opts.input_downsize + first;
+            if (opts.input_clamp_size)
+                o.input_clamp_size = opts.input_clamp_size + first;
+            ShardCallback cb = { &opts, shard_inputs.data() + first, &callback_lock };
+            if (opts.callback) {
+                o.callback = shard_callback;
+                o.callback_data = &cb;
+            }
+            std::string path = shard_path(output, shard).string();
+            if (merge_inputs(o, count, files + first, path.c_str(), 0,
+                             scans.data() + first, errors[shard]))
+                failed[shard] = 1;
+        });
+
+    // Output is complete or absent, shards written before failure are
+    // removed
+    auto remove_shards = [&]() {
+        sys::error_code ec;
+        for (int shard = 0; shard < nshards; ++shard) {
+            const fs::path path = shard_path(output, shard);
+            if (fs::is_regular_file(path, ec))
+                fs::remove(path, ec);
+        }
+    };
+    for (int shard = 0; shard < nshards; ++shard) {
+        if (failed[shard]) {
+            err_msg = errors[shard];
+            remove_shards();
+            return -1;
+        }
+    }
+
+    fs::path manifest = output.parent_path() / output.stem();
+    manifest += ".manifest";
+    std::ofstream out(manifest.string().c_str());
+    for (int i = 0; i < nfiles; ++i) {
+        fs::path input = fs::absolute(files[i], root);
+        out << strip_prefix(input, root).string() << "\t"
+            << shard_path(output, input_shard[i]).filename().string() << "\t"
+            << input_offset[i] << "\n";
     }
-    if (str[0])
-        names.push_back(str);
+    out.close();
+    if (!out) {
+        err_msg = "Writing manifest " + manifest.string();
+        remove_shards();
+        sys::error_code ec;
+        fs::remove(manifest, ec);
+        return -1;
+    }
+
+    if (shards)
+        std::copy(begin(input_shard), end(input_shard), shards);
+    if (offsets)
+        std::copy(begin(input_offset), end(input_offset), offsets);
+    return 0;
 }
 
+// Reads merged file and opens its changed sources, which are hashed,
+// opened and validated on num_threads threads.
 static
 int parse_remerge(InputInfo &info,
                   const char *file,
                   const char *searchdir,
+                  int num_threads,
                   std::vector<std::string> &names,
                   Ptex::String &err_msg)
 {
@@ -401,6 +1093,9 @@ int parse_remerge(InputInfo &info,
     if (!ptx) {
 	return -1;
     }
+    // Virtual merge reads its sources directly, nothing to update
+    if (is_virtual(ptx.get()))
+        return 0;
 
     sys::error_code ec;
     std::time_t dtime = fs::last_write_time(file, ec);
@@ -414,6 +1109,7 @@ int parse_remerge(InputInfo &info,
     info.options.num_channels  = ptx->numChannels();
     info.options.alpha_channel = ptx->alphaChannel();
     info.num_faces     = ptx->numFaces();
+    info.mipmaps       = ptx->hasMipMaps();
 
     MetaPtr meta(ptx->getMetaData());
 
@@ -437,31 +1133,99 @@ int parse_remerge(InputInfo &info,
         err_msg = "Number of offsets and file names in meta does not match";
         return -1;
     }
+    // Sources are reduced same way as when merged
+    const int8_t *downsizes = 0, *clamp_sizes = 0;
+    int ndownsizes = 0, nclamp_sizes = 0;
+    meta->getValue("PtexMergedDownsize", downsizes, ndownsizes);
+    meta->getValue("PtexMergedClampSize", clamp_sizes, nclamp_sizes);
+    if (ndownsizes != noffsets || nclamp_sizes != noffsets)
+        downsizes = clamp_sizes = 0;
+
     fs::path dir(searchdir);
-    for (size_t i = 0; i < names.size(); ++i) {
+    std::vector<std::string> paths;
+    for (const std::string &name : names)
+        paths.push_back((dir / name).string());
 
-        fs::path full_name = dir / names[i];
+    // Sources with changed content if digests are stored, newer than
+    // merged file otherwise. Sources which can't be read are kept.
+    std::vector<char> changed(names.size(), 0);
+    std::vector<uint64_t> stored;
+    if (read_uint64_meta(meta.get(), "PtexMergedDigests", stored) &&
+        stored.size() == names.size()) {
+        file_digests(paths, num_threads, info.source_digests);
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (info.source_digests[i] == 0)
+                info.source_digests[i] = stored[i];
+            changed[i] = info.source_digests[i] != stored[i];
+        }
+    }
+    else {
+        parallel_for(names.size(), num_threads, [&](int i) {
+                sys::error_code mec;
+                std::time_t md = fs::last_write_time(paths[i], mec);
+                changed[i] = !mec && md > dtime;
+            });
+    }
 
-        std::time_t md = fs::last_write_time(full_name, ec);
-        if (!ec && md > dtime)
-        {
-            PtxPtr ptex(PtexTexture::open(full_name.c_str(), err_msg, 0));
+    // Sources recorded with topology must keep it
+    std::vector<uint64_t> topologies;
+    if (!read_uint64_meta(meta.get(), "PtexMergedTopology", topologies) ||
+        topologies.size() != names.size())
+        topologies.assign(names.size(), 0);
+
+    // Changed sources are opened concurrently, first failure in source
+    // order is reported
+    std::vector<PtxPtr> ptexes(names.size());
+    std::vector<int> status(names.size(), 0);
+    std::vector<Ptex::String> errors(names.size());
+    parallel_for(names.size(), num_threads, [&](int i) {
+            if (!changed[i])
+                return;
+            PtxPtr ptex(ptex_utils::ptex_open(paths[i].c_str(), 0, errors[i]));
             if (!ptex) {
-                return -1;
+                status[i] = -1;
+                return;
+            }
+            if (check_ptx(info.options, ptex.get(), errors[i])) {
+                status[i] = 2;
+                return;
             }
-            if (check_ptx(info.options, ptex.get(), err_msg))
-                return 2;
-            if ( (i != names.size() -1 && offsets[i+1]-offsets[i] < ptex->numFaces())
+            if ( (size_t(i) != names.size() -1 && offsets[i+1]-offsets[i] < ptex->numFaces())
                  ||  (info.num_faces - offsets[i]) < ptex->numFaces())
             {
-                err_msg = Ptex::String("Ptex number of faces is more than in merged: ")
+                errors[i] = Ptex::String("Ptex number of faces is more than in merged: ")
                     + ptex->path();
-                return 2;
+                status[i] = 2;
+                return;
+            }
+            if (topologies[i]) {
+                const uint64_t topology = texture_topology(ptex.get());
+                if (topology && topology != topologies[i]) {
+                    errors[i] = Ptex::String("Source topology changed: ") + ptex->path();
+                    status[i] = 2;
+                    return;
+                }
+            }
+            ptexes[i] = std::move(ptex);
+        });
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (status[i]) {
+            err_msg = errors[i];
+            return status[i];
+        }
+        if (ptexes[i])
+        {
+            int nf = ptexes[i]->numFaces();
+            InputResize resize;
+            if (downsizes) {
+                resize.downsize = downsizes[i];
+                resize.clamp_size = clamp_sizes[i];
             }
-            info.add(offsets[i], 0, ptex);
+            info.add(paths[i], offsets[i], 0, nf, ptexes[i], resize);
         } else {
             PtxPtr p;
-            info.add(0,0,p);
+            info.add(paths[i], 0, 0, 0, p);
         }
     }
     return 0;
@@ -470,40 +1234,287 @@ int parse_remerge(InputInfo &info,
 int ptex_utils::ptex_remerge(const char *file,
                              const char *searchdir,
                              Ptex::String &err_msg)
+{
+    return ptex_remerge(file, searchdir, 1, err_msg);
+}
+
+int ptex_utils::ptex_remerge(const char *file,
+                             const char *searchdir,
+                             int num_threads,
+                             Ptex::String &err_msg)
+{
+    PtexRemergeOptions opts;
+    opts.num_threads = num_threads;
+    return ptex_remerge(opts, file, searchdir, err_msg);
+}
+
+int ptex_utils::ptex_remerge(const PtexRemergeOptions &opts,
+                             const char *file,
+                             const char *searchdir,
+                             Ptex::String &err_msg)
 {
     InputInfo info;
     std::vector<std::string> names;
 
-    int status = parse_remerge(info, file, searchdir, names, err_msg);
+    int status = parse_remerge(info, file, searchdir, opts.num_threads, names, err_msg);
     if (status)
         return status;
+    info.options.num_threads = opts.num_threads;
 
     if (std::all_of(std::begin(info.ptexes),
                     std::end(info.ptexes),
                     [](const PtxPtr & p) -> bool { return !p; })) {
         return 0;
     }
-    WriterPtr writer(PtexWriter::edit(file, false,
+
+    // Whole file is rewritten when edits grow over limits, which folds
+    // previous edits too
+    EditState state;
+    bool incremental = opts.incremental;
+    if (incremental) {
+        PtxPtr ptx(PtexTexture::open(file, err_msg, 0));
+        if (!ptx || read_edit_state(ptx.get(), state, err_msg))
+            return -1;
+        if ((opts.max_edits > 0 && state.count >= opts.max_edits) ||
+            (opts.max_edit_bytes > 0 && state.size - state.base_size > opts.max_edit_bytes))
+            incremental = false;
+    }
+    WriterPtr writer(PtexWriter::edit(file, incremental,
                                       info.options.mesh_type,
                                       info.options.data_type,
                                       info.options.num_channels,
                                       info.options.alpha_channel,
                                       info.num_faces,
-                                      err_msg));
+                                      err_msg,
+                                      info.mipmaps));
     if (!writer)
 	return -1;
 
+    std::vector<int> inputs;
     for (size_t i = 0; i < names.size(); ++i) {
-        if (info.ptexes[i]) {
-            if (append_ptexture(info.options, writer.get(), info.offsets[i],
-                                info.ptexes[i].get()))
-            {
+        if (info.ptexes[i])
+            inputs.push_back(i);
+    }
+    if (append_inputs(info.options, info, inputs, writer.get(), err_msg))
+        return -1;
+    if (!info.source_digests.empty())
+        write_uint64_meta(writer.get(), "PtexMergedDigests", info.source_digests);
+    if (opts.incremental)
+        write_edit_state(writer.get(), incremental ? state.count + 1 : 0, state.base_size);
+    if(!writer->close(err_msg)) {
+       return -1;
+    }
+    return 0;
+}
+
+int ptex_utils::ptex_compact(const char *file, const char *output_file,
+                             Ptex::String &err_msg)
+{
+    PtxPtr ptx(PtexTexture::open(file, err_msg, 0));
+    if (!ptx) {
+        err_msg = "Can't open for reading " + std::string(file) + ":" + err_msg;
+        return -1;
+    }
+    const bool edits = ptx->hasEdits();
+    ptx.reset();
+
+    const char *target = file;
+    sys::error_code ec;
+    if (output_file && !(fs::exists(output_file, ec) && fs::equivalent(file, output_file, ec))) {
+        fs::copy_file(file, output_file, fs::copy_option::overwrite_if_exists, ec);
+        if (ec) {
+            err_msg = "Can't copy to " + std::string(output_file) + ":" + ec.message();
+            return -1;
+        }
+        target = output_file;
+    }
+    if (edits && !PtexWriter::applyEdits(target, err_msg)) {
+        err_msg = "Can't apply edits " + std::string(target) + ":" + err_msg;
+        return -1;
+    }
+    return 0;
+}
+
+// Mesh meta of merged faces [first, last) and vertices [vfirst, vlast)
+// with vertex indices rebased to vfirst
+static
+void split_mesh(const int32_t *nverts, const int32_t *verts, int nverts_count,
+                const float *pos, int first, int last, int vfirst, int vlast,
+                obj_mesh &mesh) {
+    first = std::min(first, nverts_count);
+    last = std::min(last, nverts_count);
+    const int32_t start = std::accumulate(nverts, nverts + first, 0);
+    const int32_t count = std::accumulate(nverts + first, nverts + last, 0);
+    mesh.nverts.assign(nverts + first, nverts + last);
+    if (count == 0)
+        return;
+    const int32_t *fverts = verts + start;
+    mesh.verts.resize(count);
+    std::transform(fverts, fverts + count, begin(mesh.verts),
+                   [&](int32_t v) { return v - vfirst; });
+    mesh.pos.assign(pos + vfirst*3, pos + vlast*3);
+}
+
+// First vertex of every source in merged mesh and total vertex count.
+// Files merged before vertex offsets were stored split vertices after
+// last one referenced by faces of preceding sources.
+static
+void source_vertex_ranges(PtexMetaData *meta, const int32_t *mesh_offsets, int noffsets,
+                          const int32_t *nverts, const int32_t *verts, int nverts_count,
+                          int pos_count, std::vector<int32_t> &vstart) {
+    vstart.assign(noffsets + 1, 0);
+    vstart[noffsets] = pos_count / 3;
+    const int32_t *vert_offsets = 0;
+    int nvert_offsets = 0;
+    meta->getValue("PtexMergedVertOffsets", vert_offsets, nvert_offsets);
+    if (vert_offsets && nvert_offsets == noffsets) {
+        std::copy(vert_offsets, vert_offsets + noffsets, begin(vstart));
+    }
+    else {
+        int32_t face = 0, fv = 0, next = 0;
+        for (int k = 1; k < noffsets; ++k) {
+            for (; face < std::min(mesh_offsets[k], nverts_count); ++face) {
+                for (int32_t i = 0; i < nverts[face]; ++i, ++fv)
+                    next = std::max(next, verts[fv] + 1);
+            }
+            vstart[k] = next;
+        }
+    }
+    // Ranges outside of positions are clamped
+    for (int k = noffsets; k >= 0; --k) {
+        vstart[k] = std::min(std::max(vstart[k], 0), vstart[noffsets]);
+        if (k < noffsets)
+            vstart[k] = std::min(vstart[k], vstart[k + 1]);
+    }
+}
+
+int ptex_utils::ptex_split(const char *file, const char *output_dir,
+                           int num_threads, Ptex::String &err_msg)
+{
+    PtxPtr ptx(ptex_open(file, 0, err_msg));
+    if (!ptx)
+        return -1;
+    MetaPtr meta(ptx->getMetaData());
+
+    const char* filenames = 0;
+    meta->getValue("PtexMergedFiles", filenames);
+    const int32_t *offsets = 0;
+    int noffsets = 0;
+    meta->getValue("PtexMergedOffsets", offsets, noffsets);
+    if (!filenames || !offsets) {
+        err_msg = "PtexMergedFiles meta not set, probably not a merged file";
+        return -1;
+    }
+    std::vector<std::string> names;
+    split_names(filenames, names);
+    if ((size_t) noffsets != names.size()) {
+        err_msg = "Number of offsets and file names in meta does not match";
+        return -1;
+    }
+
+    const int32_t *mesh_offsets = 0, *nverts = 0, *verts = 0;
+    const float *pos = 0;
+    int nmesh_offsets = 0, nverts_count = 0, verts_count = 0, pos_count = 0;
+    meta->getValue("PtexMergedMeshOffsets", mesh_offsets, nmesh_offsets);
+    meta->getValue("PtexFaceVertCounts", nverts, nverts_count);
+    meta->getValue("PtexFaceVertIndices", verts, verts_count);
+    meta->getValue("PtexVertPositions", pos, pos_count);
+    const bool split_meshes = mesh_offsets && nmesh_offsets == noffsets
+        && nverts && verts && pos;
+    std::vector<int32_t> vstart;
+    if (split_meshes)
+        source_vertex_ranges(meta.get(), mesh_offsets, noffsets, nverts, verts, nverts_count,
+                             pos_count, vstart);
+
+    PtexMergeOptions options;
+    options.data_type = ptx->dataType();
+    options.num_channels = ptx->numChannels();
+
+    const int nfaces = ptx->numFaces();
+    // Names are written under output directory, each to its own file
+    const fs::path dir(output_dir ? output_dir : ".");
+    std::vector<std::string> paths;
+    std::set<std::string> seen;
+    for (const std::string &name : names) {
+        fs::path path = dir;
+        for (const fs::path &part : fs::path(name).relative_path()) {
+            if (part == "..") {
+                err_msg = "Merged file name leaves output directory: " + name;
                 return -1;
             }
+            if (part != ".")
+                path /= part;
+        }
+        paths.push_back(path.string());
+        if (!seen.insert(paths.back()).second) {
+            err_msg = "Several merged files split to same output: " + paths.back();
+            return -1;
         }
     }
-    if(!writer->close(err_msg)) {
-       return -1;
+
+    std::vector<Ptex::String> errors(names.size());
+    std::vector<char> failed(names.size(), 0);
+    parallel_for(names.size(), num_threads, [&](int k) {
+            const int first = offsets[k];
+            const int last = k + 1 < noffsets ? offsets[k+1] : nfaces;
+            if (first < 0 || last > nfaces || last < first) {
+                errors[k] = "Offsets in meta do not match number of faces";
+                failed[k] = 1;
+                return;
+            }
+            sys::error_code ec;
+            fs::create_directories(fs::path(paths[k]).parent_path(), ec);
+            WriterPtr writer(PtexWriter::open(paths[k].c_str(),
+                                              ptx->meshType(),
+                                              ptx->dataType(),
+                                              ptx->numChannels(),
+                                              ptx->alphaChannel(),
+                                              last - first,
+                                              errors[k]));
+            if (!writer) {
+                errors[k] = "Can't open for writing " + paths[k] + ":" + errors[k];
+                failed[k] = 1;
+                return;
+            }
+            writer->setBorderModes(ptx->uBorderMode(), ptx->vBorderMode());
+
+            FaceScratch scratch;
+            MergeFace face;
+            for (int i = first; i < last; ++i) {
+                read_face(options, ptx.get(), -first, i, InputResize(), scratch, face);
+                for (int e = 0; e < 4; ++e) {
+                    int32_t &adj = face.info.adjfaces[e];
+                    if (adj < 0 || adj >= last - first)
+                        adj = -1;
+                }
+                write_face(writer.get(), face);
+            }
+
+            if (split_meshes) {
+                const int mfirst = mesh_offsets[k];
+                const int mlast = k + 1 < noffsets ? mesh_offsets[k+1] : nverts_count;
+                obj_mesh mesh;
+                split_mesh(nverts, verts, nverts_count, pos, mfirst, mlast,
+                           vstart[k], vstart[k + 1], mesh);
+                if (!mesh.nverts.empty()) {
+                    writer->writeMeta("PtexFaceVertCounts",
+                                      mesh.nverts.data(), mesh.nverts.size());
+                    writer->writeMeta("PtexFaceVertIndices",
+                                      mesh.verts.data(), mesh.verts.size());
+                    writer->writeMeta("PtexVertPositions",
+                                      mesh.pos.data(), mesh.pos.size());
+                }
+            }
+            if (!writer->close(errors[k])) {
+                errors[k] = "Closing writer " + paths[k] + ":" + errors[k].c_str();
+                failed[k] = 1;
+            }
+        });
+    for (size_t k = 0; k < names.size(); ++k) {
+        if (failed[k]) {
+            err_msg = errors[k];
+            return -1;
+        }
     }
     return 0;
 }
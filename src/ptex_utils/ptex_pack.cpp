@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ptexutils.hpp"
+#include "convert.hpp"
+#include "helpers.hpp"
+#include "parallel.hpp"
+
+using PtexPackInput = ptex_utils::PtexPackInput;
+
+namespace {
+
+struct PackSource {
+    PtxPtr ptex;
+    int first_channel;
+    int num_channels;
+    int out_channel;  // first channel in output pixel
+};
+
+struct PackedFace {
+    Ptex::FaceInfo info;
+    std::vector<char> data;
+};
+
+// Buffers owned by one packing thread
+struct PackScratch {
+    std::vector<char> input;
+    std::vector<char> converted;
+};
+
+int open_sources(int ninputs, const PtexPackInput *inputs,
+                 std::vector<PackSource> &sources, int &nchannels,
+                 Ptex::String &err_msg)
+{
+    nchannels = 0;
+    for (int k = 0; k < ninputs; ++k) {
+        PackSource src;
+        src.ptex.reset(ptex_utils::ptex_open(inputs[k].file, 0, err_msg));
+        if (!src.ptex) {
+            err_msg = std::string("Opening input file: ") + inputs[k].file +
+                ":" + std::string(err_msg.c_str());
+            return -1;
+        }
+        const int available = src.ptex->numChannels() - inputs[k].first_channel;
+        src.first_channel = inputs[k].first_channel;
+        src.num_channels = inputs[k].num_channels > 0 ? inputs[k].num_channels : available;
+        if (src.first_channel < 0 || src.num_channels <= 0 || src.num_channels > available) {
+            err_msg = std::string("Not enough channels in file: ") + inputs[k].file;
+            return -1;
+        }
+        src.out_channel = nchannels;
+        nchannels += src.num_channels;
+        sources.emplace_back(std::move(src));
+    }
+
+    PtexTexture *first = sources[0].ptex.get();
+    std::vector<Ptex::FaceInfo> first_faces(first->numFaces()), faces;
+    for (int i = 0; i < first->numFaces(); ++i)
+        first_faces[i] = first->getFaceInfo(i);
+    for (int k = 1; k < ninputs; ++k) {
+        PtexTexture *ptex = sources[k].ptex.get();
+        bool match = ptex->meshType() == first->meshType()
+            && ptex->numFaces() == first->numFaces();
+        if (match) {
+            faces.resize(ptex->numFaces());
+            for (int i = 0; i < ptex->numFaces(); ++i)
+                faces[i] = ptex->getFaceInfo(i);
+            match = ptex_utils::ptex_topology_match(faces.size(), first_faces.data(),
+                                                    faces.data());
+        }
+        if (!match) {
+            err_msg = std::string("Topology does not match first input: ") + inputs[k].file;
+            return -1;
+        }
+    }
+
+    // Non constant faces are packed as they are, so they must agree on
+    // resolution
+    for (int i = 0; i < first->numFaces(); ++i) {
+        int res_input = -1;
+        for (int k = 0; k < ninputs; ++k) {
+            const Ptex::FaceInfo &f = sources[k].ptex->getFaceInfo(i);
+            if (f.isConstant())
+                continue;
+            if (res_input < 0) {
+                res_input = k;
+                continue;
+            }
+            const Ptex::Res &res = sources[res_input].ptex->getFaceInfo(i).res;
+            if (f.res.ulog2 != res.ulog2 || f.res.vlog2 != res.vlog2) {
+                err_msg = "Resolution of face " + std::to_string(i) + " in " +
+                    inputs[k].file + " does not match " + inputs[res_input].file;
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Output face is constant if all inputs are, otherwise it has resolution
+// of non constant input faces
+Ptex::FaceInfo packed_face_info(std::vector<PackSource> &sources, int i)
+{
+    Ptex::FaceInfo out = sources[0].ptex->getFaceInfo(i);
+    bool constant = true;
+    for (PackSource &src : sources) {
+        const Ptex::FaceInfo &f = src.ptex->getFaceInfo(i);
+        if (f.isConstant())
+            continue;
+        out.res = f.res;
+        constant = false;
+        break;
+    }
+    if (constant)
+        out.flags |= Ptex::FaceInfo::flag_constant;
+    else
+        out.flags &= ~Ptex::FaceInfo::flag_constant;
+    return out;
+}
+
+void pack_face(std::vector<PackSource> &sources, Ptex::DataType dt, int nchannels,
+               int i, PackScratch &scratch, PackedFace &out)
+{
+    out.info = packed_face_info(sources, i);
+    const int npixels = out.info.isConstant() ? 1 : out.info.res.size();
+    const size_t value_size = Ptex::DataSize(dt);
+    const size_t pixel_size = value_size * nchannels;
+    if (out.data.size() < npixels * pixel_size)
+        out.data.resize(npixels * pixel_size);
+
+    for (PackSource &src : sources) {
+        PtexTexture *ptex = src.ptex.get();
+        const Ptex::DataType src_dt = ptex->dataType();
+        const int src_nchannels = ptex->numChannels();
+        const size_t src_pixel_size = Ptex::DataSize(src_dt) * src_nchannels;
+        if (scratch.input.size() < npixels * src_pixel_size)
+            scratch.input.resize(npixels * src_pixel_size);
+        if (scratch.converted.size() < npixels * value_size * src.num_channels)
+            scratch.converted.resize(npixels * value_size * src.num_channels);
+
+        // Constant output is read as single pixel
+        Ptex::Res res = out.info.isConstant() ? Ptex::Res(0, 0) : out.info.res;
+        ptex->getData(i, scratch.input.data(), 0, res);
+        const char *first = scratch.input.data() + src.first_channel * Ptex::DataSize(src_dt);
+        convert_pixels(scratch.converted.data(), dt, first, src_dt, src_nchannels,
+                       src.num_channels, npixels);
+
+        const size_t size = value_size * src.num_channels;
+        const char *from = scratch.converted.data();
+        char *to = out.data.data() + value_size * src.out_channel;
+        for (int p = 0; p < npixels; ++p, from += size, to += pixel_size)
+            std::memcpy(to, from, size);
+    }
+}
+
+void write_pack_meta(std::vector<PackSource> &sources, int ninputs,
+                     const PtexPackInput *inputs, PtexWriter *writer)
+{
+    MetaPtr meta(sources[0].ptex->getMetaData());
+    const int32_t *counts = 0, *indices = 0;
+    const float *positions = 0;
+    int ncounts = 0, nindices = 0, npositions = 0;
+    meta->getValue("PtexFaceVertCounts", counts, ncounts);
+    meta->getValue("PtexFaceVertIndices", indices, nindices);
+    meta->getValue("PtexVertPositions", positions, npositions);
+    if (counts && indices && positions) {
+        writer->writeMeta("PtexFaceVertCounts", counts, ncounts);
+        writer->writeMeta("PtexFaceVertIndices", indices, nindices);
+        writer->writeMeta("PtexVertPositions", positions, npositions);
+    }
+
+    std::string joined;
+    std::vector<int32_t> channels;
+    for (int k = 0; k < ninputs; ++k) {
+        if (k)
+            joined.push_back(':');
+        joined.append(inputs[k].file);
+        channels.push_back(sources[k].first_channel);
+        channels.push_back(sources[k].num_channels);
+    }
+    writer->writeMeta("PtexPackedFiles", joined.c_str());
+    writer->writeMeta("PtexPackedChannels", channels.data(), channels.size());
+}
+
+}
+
+int ptex_utils::ptex_pack(int ninputs, const PtexPackInput *inputs,
+                          const char *output_file,
+                          Ptex::DataType data_type, int alpha_channel,
+                          int num_threads,
+                          Ptex::String &err_msg)
+{
+    if (ninputs < 1) {
+        err_msg = "At least one file required";
+        return -1;
+    }
+    std::vector<PackSource> sources;
+    int nchannels = 0;
+    if (open_sources(ninputs, inputs, sources, nchannels, err_msg))
+        return -1;
+    if (alpha_channel >= nchannels) {
+        err_msg = "Alpha channel is out of packed channels";
+        return -1;
+    }
+
+    PtexTexture *first = sources[0].ptex.get();
+    const int nfaces = first->numFaces();
+    WriterPtr writer(PtexWriter::open(output_file,
+                                      first->meshType(),
+                                      data_type,
+                                      nchannels,
+                                      alpha_channel,
+                                      nfaces,
+                                      err_msg));
+    if (!writer) {
+        err_msg = "Can't open for writing " + std::string(output_file) + ":" + err_msg;
+        return -1;
+    }
+    writer->setBorderModes(first->uBorderMode(), first->vBorderMode());
+
+    const int nthreads = std::min(resolve_threads(num_threads), std::max(nfaces, 1));
+    std::vector<PackScratch> scratch(nthreads);
+    std::vector<PackedFace> slots(nthreads > 1 ? nthreads*4 : 1);
+    auto produce = [&](int worker, int i, PackedFace &face) -> int {
+        pack_face(sources, data_type, nchannels, i, scratch[worker], face);
+        return 0;
+    };
+    auto consume = [&](int i, PackedFace &face) -> int {
+        const bool written = face.info.isConstant()
+            ? writer->writeConstantFace(i, face.info, face.data.data())
+            : writer->writeFace(i, face.info, face.data.data(), 0);
+        if (!written) {
+            err_msg = "Writing face " + std::to_string(i) + " of " + std::string(output_file);
+            return -1;
+        }
+        return 0;
+    };
+    if (ordered_pipeline(nfaces, nthreads, slots, produce, consume))
+        return -1;
+
+    write_pack_meta(sources, ninputs, inputs, writer.get());
+    if (!writer->close(err_msg)) {
+        err_msg = "Closing writer " + std::string(output_file) + ":" + err_msg.c_str();
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <string>
+#include <vector>
+
+#include "ptexutils.hpp"
+#include "convert.hpp"
+#include "helpers.hpp"
+
+using PtexPatchFace = ptex_utils::PtexPatchFace;
+
+int ptex_utils::ptex_patch(const char *file,
+                           int nfaces, const PtexPatchFace *faces,
+                           Ptex::DataType data_type, int num_channels,
+                           Ptex::String &err_msg)
+{
+    PtxPtr ptx(PtexTexture::open(file, err_msg, 0));
+    if (!ptx) {
+        err_msg = "Can't open for reading " + std::string(file) + ":" + err_msg;
+        return -1;
+    }
+    MetaPtr meta(ptx->getMetaData());
+    const int8_t *marker = 0;
+    int count = 0;
+    meta->getValue("PtexVirtualMerge", marker, count);
+    if (marker && count == 1 && marker[0]) {
+        err_msg = "Faces of virtual merge are in its sources: " + std::string(file);
+        return -1;
+    }
+
+    const Ptex::DataType dt = ptx->dataType();
+    const int nchannels = ptx->numChannels();
+    if (num_channels < nchannels) {
+        err_msg = "Patch has fewer channels than " + std::string(file);
+        return -1;
+    }
+    for (int k = 0; k < nfaces; ++k) {
+        const PtexPatchFace &f = faces[k];
+        if (f.face_id < 0 || f.face_id >= ptx->numFaces() || !f.data) {
+            err_msg = "Invalid patch face " + std::to_string(f.face_id);
+            return -1;
+        }
+        if (!f.constant && (f.res.ulog2 < 0 || f.res.vlog2 < 0 ||
+                            f.res.ulog2 > 15 || f.res.vlog2 > 15)) {
+            err_msg = "Invalid resolution of patch face " + std::to_string(f.face_id);
+            return -1;
+        }
+    }
+
+    // Face infos keep adjacency of file
+    std::vector<Ptex::FaceInfo> infos(nfaces);
+    for (int k = 0; k < nfaces; ++k) {
+        infos[k] = ptx->getFaceInfo(faces[k].face_id);
+        if (faces[k].constant) {
+            infos[k].flags |= Ptex::FaceInfo::flag_constant;
+        }
+        else {
+            infos[k].res = faces[k].res;
+            infos[k].flags &= ~Ptex::FaceInfo::flag_constant;
+        }
+    }
+    const Ptex::MeshType mesh_type = ptx->meshType();
+    const int alpha_channel = ptx->alphaChannel();
+    const int num_faces = ptx->numFaces();
+    // Patch counts as one more edit for remerge limits
+    EditState state;
+    if (read_edit_state(ptx.get(), state, err_msg))
+        return -1;
+    ptx.reset();
+    meta.reset();
+
+    // Incremental edit appends only patched faces to file
+    WriterPtr writer(PtexWriter::edit(file, true, mesh_type, dt, nchannels,
+                                      alpha_channel, num_faces, err_msg));
+    if (!writer) {
+        err_msg = "Can't open for writing " + std::string(file) + ":" + err_msg;
+        return -1;
+    }
+    const bool same_format = data_type == dt && num_channels == nchannels;
+    std::vector<char> converted;
+    for (int k = 0; k < nfaces; ++k) {
+        const PtexPatchFace &f = faces[k];
+        const Ptex::FaceInfo &info = infos[k];
+        const size_t npixels = f.constant ? 1 : info.res.size();
+        const void *data = f.data;
+        if (!same_format) {
+            converted.resize(npixels * Ptex::DataSize(dt) * nchannels);
+            convert_pixels(converted.data(), dt, f.data, data_type, num_channels,
+                           nchannels, npixels);
+            data = converted.data();
+        }
+        bool written = f.constant ? writer->writeConstantFace(f.face_id, info, data)
+            : writer->writeFace(f.face_id, info, data, 0);
+        if (!written) {
+            err_msg = "Can't write patch face " + std::to_string(f.face_id);
+            return -1;
+        }
+    }
+    write_edit_state(writer.get(), state.count + 1, state.base_size);
+    if (!writer->close(err_msg)) {
+        err_msg = "Closing writer " + std::string(file) + ":" + err_msg.c_str();
+        return -1;
+    }
+    return 0;
+}
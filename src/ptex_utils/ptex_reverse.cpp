@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "ptexutils.hpp"
+#include "convert.hpp"
 
 static Ptex::EdgeId swap_edge(Ptex::EdgeId i) {
     switch((int) i) {
@@ -121,7 +122,7 @@ int ptex_utils::ptex_reverse(const char* file,
                              Ptex::String &err_msg)
 {
 
-    PtexTexture* input( PtexTexture::open(file, err_msg, false));
+    PtexTexture* input(ptex_open(file, 0, err_msg));
     if (input == 0)
         return -1;
 
@@ -144,36 +145,34 @@ int ptex_utils::ptex_reverse(const char* file,
 
     output->setBorderModes(input->uBorderMode(), input->vBorderMode());
 
-    int data_block_size = Ptex::DataSize(data_type)*num_channels;
-    int data_size = data_block_size*512*512;
-    void *data = malloc(data_size);
-    void *outdata = malloc(data_size);
+    const int data_block_size = Ptex::DataSize(data_type)*num_channels;
+    std::vector<char> data, outdata(data_block_size);
     face_map subface_map;
     build_subface_map(input, subface_map);
     for (int i = 0; i < num_faces; ++i) {
         const Ptex::FaceInfo &face_info = input->getFaceInfo(i);
         Ptex::FaceInfo out_face = prepare_faceinfo(subface_map, face_info);
-        int stride = data_block_size*out_face.res.size();
-
-        if (stride > data_size) {
-            data_size = stride;
-            data = realloc(data, data_size);
-            outdata = realloc(data, data_size);
-        }
-
-        input->getData(i, data, 0);
         int out_id = subface_id(subface_map, i);
         if (face_info.isConstant()) {
-            output->writeConstantFace(out_id, out_face, data);
-        } else {
-            out_face.res.swapuv();
-            swap_data(data_block_size, face_info.res.u(), face_info.res.v(), (char *) data,
-                      (char *) outdata);
-            output->writeFace(out_id, out_face, outdata);
+            // Only value of constant face is read, buffers keep their size
+            input->getData(i, outdata.data(), 0, Ptex::Res(0, 0));
+            output->writeConstantFace(out_id, out_face, outdata.data());
+            continue;
+        }
+
+        const size_t size = data_block_size*face_info.res.size();
+        if (outdata.size() < size)
+            outdata.resize(size);
+        out_face.res.swapuv();
+        // Tiles are transposed straight into output face
+        if (!read_face_tiles(input, i, outdata.data(), data_type, num_channels, true)) {
+            data.resize(size);
+            input->getData(i, data.data(), 0);
+            swap_data(data_block_size, face_info.res.u(), face_info.res.v(), data.data(),
+                      outdata.data());
         }
+        output->writeFace(out_id, out_face, outdata.data());
     }
-    free(data);
-    free(outdata);
     reverse_meta(input, output);
     int res = !output->close(err_msg);
     input->release();
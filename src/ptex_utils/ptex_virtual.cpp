@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "ptexutils.hpp"
+#include "helpers.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+// Virtual merged texture. Adjacency and meta come from index file, face
+// data and flags are read from sources opened on first access. Faces of
+// source that can't be opened or does not match index read as zero
+// constant faces of index.
+class VirtualTexture : public PtexTexture {
+public:
+    VirtualTexture(PtexTexture *index) : _index(index) {}
+
+    int init(const char *searchdir, Ptex::String &err_msg) {
+        MetaPtr meta(_index->getMetaData());
+        const char *filenames = 0;
+        meta->getValue("PtexMergedFiles", filenames);
+        const int32_t *offsets = 0;
+        int noffsets = 0;
+        meta->getValue("PtexMergedOffsets", offsets, noffsets);
+        if (!filenames || !offsets) {
+            err_msg = std::string("Virtual merge sources not set: ") + _index->path();
+            return -1;
+        }
+        std::vector<std::string> names;
+        split_names(filenames, names);
+        if ((size_t) noffsets != names.size()) {
+            err_msg = "Number of offsets and file names in meta does not match";
+            return -1;
+        }
+        const int8_t *mipmaps = 0;
+        int count = 0;
+        meta->getValue("PtexVirtualMipMaps", mipmaps, count);
+        _mipmaps = mipmaps && count == 1 && mipmaps[0];
+
+        fs::path dir = searchdir ? fs::path(searchdir)
+            : fs::absolute(_index->path()).parent_path();
+        boost::system::error_code ec;
+        for (size_t i = 0; i < names.size(); ++i) {
+            fs::path p = fs::absolute(names[i], dir);
+            if (!fs::exists(p, ec)) {
+                err_msg = "Virtual merge source not found: " + p.string();
+                return -1;
+            }
+            _paths.push_back(p.string());
+        }
+        _offsets.assign(offsets, offsets + noffsets);
+        _offsets.push_back(_index->numFaces());
+        _sources.reset(new Source[names.size()]);
+        return 0;
+    }
+
+    virtual void release() {
+        delete this;
+    }
+    virtual const char* path() { return _index->path(); }
+    virtual Info getInfo() { return _index->getInfo(); }
+    virtual Ptex::MeshType meshType() { return _index->meshType(); }
+    virtual Ptex::DataType dataType() { return _index->dataType(); }
+    virtual Ptex::BorderMode uBorderMode() { return _index->uBorderMode(); }
+    virtual Ptex::BorderMode vBorderMode() { return _index->vBorderMode(); }
+    virtual Ptex::EdgeFilterMode edgeFilterMode() { return _index->edgeFilterMode(); }
+    virtual int alphaChannel() { return _index->alphaChannel(); }
+    virtual int numChannels() { return _index->numChannels(); }
+    virtual int numFaces() { return _index->numFaces(); }
+    virtual bool hasEdits() { return false; }
+    virtual bool hasMipMaps() { return _mipmaps; }
+    virtual PtexMetaData* getMetaData() { return _index->getMetaData(); }
+    virtual const Ptex::FaceInfo& getFaceInfo(int faceid) {
+        int local;
+        if (Source *src = source(faceid, local))
+            return src->infos[local];
+        return _index->getFaceInfo(faceid);
+    }
+
+    virtual void getData(int faceid, void* buffer, int stride) {
+        int local;
+        if (Source *src = source(faceid, local))
+            src->ptex.load()->getData(local, buffer, stride);
+        else
+            _index->getData(faceid, buffer, stride);
+    }
+    virtual void getData(int faceid, void* buffer, int stride, Ptex::Res res) {
+        int local;
+        if (Source *src = source(faceid, local))
+            src->ptex.load()->getData(local, buffer, stride, res);
+        else
+            _index->getData(faceid, buffer, stride, res);
+    }
+    virtual PtexFaceData* getData(int faceid) {
+        int local;
+        if (Source *src = source(faceid, local))
+            return src->ptex.load()->getData(local);
+        return _index->getData(faceid);
+    }
+    virtual PtexFaceData* getData(int faceid, Ptex::Res res) {
+        int local;
+        if (Source *src = source(faceid, local))
+            return src->ptex.load()->getData(local, res);
+        return _index->getData(faceid, res);
+    }
+    virtual void getPixel(int faceid, int u, int v,
+                          float* result, int firstchan, int nchannels) {
+        int local;
+        if (Source *src = source(faceid, local))
+            src->ptex.load()->getPixel(local, u, v, result, firstchan, nchannels);
+        else
+            _index->getPixel(faceid, u, v, result, firstchan, nchannels);
+    }
+    virtual void getPixel(int faceid, int u, int v,
+                          float* result, int firstchan, int nchannels,
+                          Ptex::Res res) {
+        int local;
+        if (Source *src = source(faceid, local))
+            src->ptex.load()->getPixel(local, u, v, result, firstchan, nchannels, res);
+        else
+            _index->getPixel(faceid, u, v, result, firstchan, nchannels, res);
+    }
+
+protected:
+    virtual ~VirtualTexture() {
+        for (size_t i = 0; _sources && i < _paths.size(); ++i) {
+            if (PtexTexture *ptex = _sources[i].ptex)
+                ptex->release();
+        }
+    }
+
+private:
+    struct Source {
+        std::atomic<PtexTexture*> ptex{0};
+        std::atomic<bool> failed{false};
+        std::vector<Ptex::FaceInfo> infos; // flags of source, adjacency of index
+    };
+
+    // Source holding faceid and face id in it, null if source is unusable
+    Source *source(int faceid, int &local) {
+        if (faceid < 0 || faceid >= _index->numFaces())
+            return 0;
+        size_t k = std::upper_bound(_offsets.begin(), _offsets.end(), faceid)
+            - _offsets.begin() - 1;
+        local = faceid - _offsets[k];
+        Source &src = _sources[k];
+        if (src.ptex.load(std::memory_order_acquire))
+            return &src;
+        if (src.failed.load(std::memory_order_relaxed))
+            return 0;
+
+        std::lock_guard<std::mutex> lock(_open_mutex);
+        if (src.ptex.load(std::memory_order_relaxed))
+            return &src;
+        if (src.failed)
+            return 0;
+        Ptex::String err_msg;
+        const int nfaces = _offsets[k+1] - _offsets[k];
+        PtxPtr ptex(ptex_utils::ptex_open(_paths[k].c_str(), 0, err_msg));
+        if (!ptex || ptex->dataType() != dataType()
+            || ptex->numChannels() != numChannels()
+            || ptex->numFaces() != nfaces) {
+            src.failed = true;
+            return 0;
+        }
+        src.infos.resize(nfaces);
+        for (int i = 0; i < nfaces; ++i) {
+            Ptex::FaceInfo f = ptex->getFaceInfo(i);
+            const Ptex::FaceInfo &merged = _index->getFaceInfo(_offsets[k] + i);
+            std::copy(merged.adjfaces, merged.adjfaces + 4, f.adjfaces);
+            src.infos[i] = f;
+        }
+        src.ptex.store(ptex.release(), std::memory_order_release);
+        return &src;
+    }
+
+    PtxPtr _index;
+    bool _mipmaps = false;
+    std::vector<std::string> _paths;
+    std::vector<int32_t> _offsets;
+    std::unique_ptr<Source[]> _sources;
+    std::mutex _open_mutex;
+};
+
+}
+
+PtexTexture* ptex_utils::ptex_open(const char *file, const char *searchdir,
+                                   Ptex::String &err_msg)
+{
+    PtxPtr ptex(PtexTexture::open(file, err_msg, 0));
+    if (!ptex)
+        return 0;
+
+    MetaPtr meta(ptex->getMetaData());
+    const int8_t *marker = 0;
+    int count = 0;
+    meta->getValue("PtexVirtualMerge", marker, count);
+    if (!marker || count != 1 || !marker[0])
+        return ptex.release();
+
+    VirtualTexture *vt = new VirtualTexture(ptex.release());
+    if (vt->init(searchdir, err_msg)) {
+        vt->release();
+        return 0;
+    }
+    return vt;
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <boost/filesystem.hpp>
+
+#include "ptexutils.hpp"
+#include "helpers.hpp"
+
+using PtexRemergeOptions = ptex_utils::PtexRemergeOptions;
+namespace fs = boost::filesystem;
+
+#ifdef __linux__
+
+namespace {
+
+// Directories holding sources with source file names in each
+using SourceDirs = std::map<std::string, std::set<std::string> >;
+
+int source_dirs(const char *file, const char *searchdir, SourceDirs &dirs,
+                Ptex::String &err_msg)
+{
+    PtxPtr ptx(PtexTexture::open(file, err_msg, 0));
+    if (!ptx)
+        return -1;
+    MetaPtr meta(ptx->getMetaData());
+    const char *filenames = 0;
+    meta->getValue("PtexMergedFiles", filenames);
+    if (!filenames) {
+        err_msg = "PtexMergedFiles meta not set, probably not a merged file";
+        return -1;
+    }
+    std::vector<std::string> names;
+    split_names(filenames, names);
+    for (const std::string &name : names) {
+        fs::path p = fs::absolute(fs::path(searchdir) / name);
+        dirs[p.parent_path().string()].insert(p.filename().string());
+    }
+    return 0;
+}
+
+struct Inotify {
+    int fd = -1;
+    ~Inotify() {
+        if (fd >= 0)
+            close(fd);
+    }
+};
+
+}
+
+int ptex_utils::ptex_remerge_watch(const PtexRemergeOptions &opts,
+                                   const char *file,
+                                   const char *searchdir,
+                                   int debounce_ms,
+                                   bool (*callback)(int, const char*, void*),
+                                   void *callback_data,
+                                   Ptex::String &err_msg)
+{
+    SourceDirs dirs;
+    if (source_dirs(file, searchdir, dirs, err_msg))
+        return -1;
+
+    // Editors often save by renaming temporary file over source, so
+    // directories are watched rather than sources themselves
+    Inotify in;
+    in.fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (in.fd < 0) {
+        err_msg = std::string("inotify_init1: ") + std::strerror(errno);
+        return -1;
+    }
+    std::map<int, const std::set<std::string>*> watches;
+    for (const SourceDirs::value_type &dir : dirs) {
+        int wd = inotify_add_watch(in.fd, dir.first.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            err_msg = "Can't watch " + dir.first + ": " + std::strerror(errno);
+            return -1;
+        }
+        watches[wd] = &dir.second;
+    }
+
+    using clock = std::chrono::steady_clock;
+    // Sources changed before watch started are picked up first
+    bool pending = true;
+    clock::time_point deadline = clock::now();
+    alignas(inotify_event) char buf[4096];
+    for (;;) {
+        int timeout = -1;
+        if (pending) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - clock::now());
+            timeout = std::max<int>(0, left.count());
+        }
+        pollfd pfd = { in.fd, POLLIN, 0 };
+        int r = poll(&pfd, 1, timeout);
+        if (r < 0 && errno != EINTR) {
+            err_msg = std::string("poll: ") + std::strerror(errno);
+            return -1;
+        }
+        if (r > 0) {
+            ssize_t len;
+            while ((len = read(in.fd, buf, sizeof(buf))) > 0) {
+                for (char *p = buf; p < buf + len; ) {
+                    const inotify_event *ev = reinterpret_cast<const inotify_event*>(p);
+                    p += sizeof(inotify_event) + ev->len;
+                    auto w = watches.find(ev->wd);
+                    bool source = (ev->mask & IN_Q_OVERFLOW) ||
+                        (ev->len && w != watches.end() && w->second->count(ev->name));
+                    if (source) {
+                        // Burst of writes is remerged once it settles
+                        pending = true;
+                        deadline = clock::now() + std::chrono::milliseconds(debounce_ms);
+                    }
+                }
+            }
+            continue;
+        }
+        if (!pending || clock::now() < deadline)
+            continue;
+
+        pending = false;
+        Ptex::String msg;
+        int status = ptex_remerge(opts, file, searchdir, msg);
+        if (callback && callback(status, msg.c_str(), callback_data))
+            return 0;
+    }
+}
+
+#else
+
+int ptex_utils::ptex_remerge_watch(const PtexRemergeOptions &,
+                                   const char *,
+                                   const char *,
+                                   int,
+                                   bool (*)(int, const char*, void*),
+                                   void *,
+                                   Ptex::String &err_msg)
+{
+    err_msg = "Watching sources is supported on Linux only";
+    return -1;
+}
+
+#endif
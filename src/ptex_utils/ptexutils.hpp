@@ -45,6 +45,13 @@ struct PtexMeta
     const void **data;
 };
 
+struct PtexMergeStats
+{
+    int64_t faces = 0;
+    int64_t texels = 0;
+    double seconds = 0; // time spent reading, converting and writing faces
+};
+
 struct PtexMergeOptions
 {
     Ptex::DataType data_type = Ptex::dt_uint8;
@@ -58,6 +65,36 @@ struct PtexMergeOptions
     void *callback_data = 0;
     const char *root = 0;
     PtexMeta * meta = 0;
+    int num_threads = 1;  // threads decoding input faces, 0 - all cores
+    int max_open_files = 0; // stream inputs keeping this many open, 0 - all
+    // Bound for face buffers in bytes, 0 - no bound. Faces are copied out
+    // of reader buffers when set, merge fails if buffers of largest face
+    // do not fit. Face info tables and caches of open readers are not
+    // counted.
+    size_t max_memory = 0;
+    PtexMergeStats *stats = 0;
+    // Skip mip maps if all inputs are already in output data type and
+    // channel count. Reductions of inputs are not carried over, readers
+    // rebuild them on every filtered lookup.
+    bool skip_mipmaps = false;
+    // Inputs that are merged files themselves record their own sources in
+    // output meta, so remerge can update them directly.
+    bool flatten_merged = true;
+    // Write only index file with face infos and meta of merged texture,
+    // faces are read from inputs when it is opened with ptex_open.
+    // Inputs must be in output data type and channel count.
+    bool virtual_merge = false;
+    // Reduce face resolution of inputs like ptex_conform does: downsize
+    // by this many log2 steps, then clamp to 2^clamp_size, 0 - keep.
+    // Per input arrays of nfiles values replace global ones if set.
+    int8_t downsize = 0;
+    int8_t clamp_size = 0;
+    const int8_t *input_downsize = 0;
+    const int8_t *input_clamp_size = 0;
+    // Store content digest of every source, remerge then updates only
+    // sources with changed content instead of comparing times. Every
+    // source is read once more to hash it. Ignored for virtual merge.
+    bool digests = false;
 };
 
 PTEXUTILS_API
@@ -65,17 +102,175 @@ int ptex_merge(int nfiles, const char** files,
 	       const char* output_file, int *offsets,
 	       Ptex::String &err_msg);
 
+struct PtexMergePlan
+{
+    int num_faces = 0;
+    int64_t constant_faces = 0;
+    int64_t texels = 0;          // constant faces count as one texel
+    int64_t data_bytes = 0;      // uncompressed size of output texels
+    int64_t output_bytes = 0;    // estimated output file size
+    int64_t peak_memory = 0;     // estimated face buffer memory of merge
+    int max_open_files = 0;
+};
+
+PTEXUTILS_API
+int ptex_merge_options(const char* file,
+                       PtexMergeOptions &opts,
+                       Ptex::String &err_msg);
+
 PTEXUTILS_API
 int ptex_merge(const PtexMergeOptions &opts,
                int nfiles, const char** files,
 	       const char* output_file, int *offsets,
 	       Ptex::String &err_msg);
 
+// Computes offsets and resource estimates of merge, reading only input
+// headers and face infos. Inputs are checked same way as ptex_merge does.
+PTEXUTILS_API
+int ptex_merge_plan(const PtexMergeOptions &opts,
+                    int nfiles, const char** files,
+                    int *offsets, PtexMergePlan &plan,
+                    Ptex::String &err_msg);
+
+// Limits of one output file of sharded merge, 0 means no limit. Bytes
+// are uncompressed texel data.
+struct PtexShardBudget
+{
+    int64_t faces = 0;
+    int64_t texels = 0;
+    int64_t bytes = 0;
+};
+
+// Splits inputs in order into shards fitting budget and merges shards
+// concurrently. Shard N of output.ptx is written to output.N.ptx and
+// output.manifest lists source, shard file and offset for every input.
+// Input larger than budget gets shard of its own. If any shard fails,
+// shards already written are removed.
+PTEXUTILS_API
+int ptex_merge_sharded(const PtexMergeOptions &opts,
+                       const PtexShardBudget &budget,
+                       int nfiles, const char** files,
+                       const char* output_file,
+                       int *shards, int *offsets, int &nshards,
+                       Ptex::String &err_msg);
+
+// Opens ptex file. Virtual merged texture is opened as single texture
+// reading faces from its sources, which are looked up in searchdir or
+// next to file if searchdir is null.
+PTEXUTILS_API
+PtexTexture* ptex_open(const char *file, const char *searchdir,
+                       Ptex::String &err_msg);
+
+struct PtexRemergeOptions
+{
+    int num_threads = 0;  // threads decoding changed sources, 0 - all cores
+    // Append changed faces as edit blocks instead of rewriting whole file.
+    // Edits are folded into file once there are more than max_edits of
+    // them or they take more than max_edit_bytes, 0 - no limit.
+    bool incremental = false;
+    int max_edits = 16;
+    size_t max_edit_bytes = 0;
+};
+
+// Rewrites faces of sources of merged file which changed since merge.
+// Sources are looked up in dir. Changed sources are opened and their faces
+// decoded on num_threads threads and written in face order.
+PTEXUTILS_API
+int ptex_remerge(const PtexRemergeOptions &opts,
+                 const char *file,
+                 const char *dir,
+                 Ptex::String &err_msg);
+
+PTEXUTILS_API
+int ptex_remerge(const char *file,
+                 const char *dir,
+                 int num_threads,
+                 Ptex::String &err_msg);
+
+// Remerge on one thread
 PTEXUTILS_API
 int ptex_remerge(const char *file,
                  const char *dir,
                  Ptex::String &err_msg);
 
+// Watches directories of sources of merged file and remerges it once
+// sources were written and no further writes came for debounce_ms.
+// Sources changed before watching are remerged first. callback gets status
+// and error message of every remerge and stops watching by returning
+// true. Supported on Linux only.
+PTEXUTILS_API
+int ptex_remerge_watch(const PtexRemergeOptions &opts,
+                       const char *file,
+                       const char *dir,
+                       int debounce_ms,
+                       bool (*callback)(int status, const char *err_msg, void *data),
+                       void *callback_data,
+                       Ptex::String &err_msg);
+
+// Folds edit blocks of file into output, or into file itself if output
+// is null. File without edits is copied as is.
+PTEXUTILS_API
+int ptex_compact(const char *file, const char *output_file,
+                 Ptex::String &err_msg);
+
+// Writes faces of every source of merged file to output_dir/<source name>
+// with adjacency and mesh meta rebased to source. Sources are written
+// concurrently on num_threads threads, 0 - all cores.
+PTEXUTILS_API
+int ptex_split(const char *file, const char *output_dir,
+               int num_threads, Ptex::String &err_msg);
+
+struct PtexPatchFace
+{
+    int32_t face_id = 0;
+    Ptex::Res res;          // resolution of data, unused for constant face
+    bool constant = false;  // data is single pixel
+    const void *data = 0;   // pixels in row order
+};
+
+// Replaces given faces of file, appending them as incremental edit so
+// other faces are not rewritten. Data of all faces is in data_type with
+// num_channels channels and is converted to file format like merge does,
+// extra channels are dropped. Faces keep adjacency and may change
+// resolution. Patch counts as edit towards max_edits and max_edit_bytes
+// of incremental remerge. Virtual merge files can't be patched.
+PTEXUTILS_API
+int ptex_patch(const char *file,
+               int nfaces, const PtexPatchFace *faces,
+               Ptex::DataType data_type, int num_channels,
+               Ptex::String &err_msg);
+
+// Maps face ids of merged texture back to sources. Built once from merge
+// meta of texture, then answers lookups of many face ids at once.
+class PTEXUTILS_API PtexMergedIndex
+{
+public:
+    PtexMergedIndex();
+    ~PtexMergedIndex();
+
+    int load(const char *file, Ptex::String &err_msg);
+    int load(PtexTexture *ptex, Ptex::String &err_msg);
+
+    int num_sources() const;
+    const char* source(int k) const; // file name as stored in meta
+    int32_t offset(int k) const;
+    int32_t mesh_offset(int k) const;
+
+    // For n merged face ids writes index of source, face id in source and
+    // mesh offset of source, -1 for face ids out of merged range. Any of
+    // outputs can be null.
+    void lookup(int64_t n, const int32_t *face_ids,
+                int32_t *sources, int32_t *local_ids,
+                int32_t *mesh_offsets) const;
+
+private:
+    PtexMergedIndex(const PtexMergedIndex&);
+    PtexMergedIndex& operator=(const PtexMergedIndex&);
+
+    struct Impl;
+    Impl *_impl;
+};
+
 PTEXUTILS_API
 int ptex_reverse(const char* file,
                  const char* output_file,
@@ -88,6 +283,25 @@ int make_constant(const char* file,
                   int nfaces, int32_t *nverts, int32_t *verts,
                   float* pos, Ptex::String &err_msg);
 
+// Same as above with adjacency built on num_threads threads, 0 - all
+// cores.
+PTEXUTILS_API
+int make_constant(const char* file,
+                  Ptex::DataType dt, int nchannels, int alphachan,
+                  const void* data,
+                  int nfaces, int32_t *nverts, int32_t *verts,
+                  float* pos, int num_threads, Ptex::String &err_msg);
+
+// Same as above, face infos are reused from adjacency_cache directory
+// like compute_adjacency does, 0 - no cache.
+PTEXUTILS_API
+int make_constant(const char* file,
+                  Ptex::DataType dt, int nchannels, int alphachan,
+                  const void* data,
+                  int nfaces, int32_t *nverts, int32_t *verts,
+                  float* pos, int num_threads, const char *adjacency_cache,
+                  Ptex::String &err_msg);
+
 PTEXUTILS_API
 int ptex_info(const char* file, PtexInfo &info, Ptex::String &err_msg);
 
@@ -98,11 +312,80 @@ PTEXUTILS_API
 void compute_adjacency(int32_t nfaces, int32_t *nverts, int32_t *verts,
                        Ptex::FaceInfo *out);
 
+// Same as above on num_threads threads, 0 - all cores. Result does not
+// depend on number of threads.
+PTEXUTILS_API
+void compute_adjacency(int32_t nfaces, int32_t *nverts, int32_t *verts,
+                       Ptex::FaceInfo *out, int num_threads);
+
+// Same as above, face infos are read from adjacency_cache directory when
+// it has them for mesh topology, otherwise computed and stored there.
+// Cache is best effort, if it can't be read or written face infos are
+// just computed.
+PTEXUTILS_API
+void compute_adjacency(int32_t nfaces, int32_t *nverts, int32_t *verts,
+                       Ptex::FaceInfo *out, int num_threads,
+                       const char *adjacency_cache);
+
+// Fingerprint of mesh face vertex counts and indices, never 0. Textures
+// written by make_constant and merge with merged mesh keep it in
+// PtexTopologyDigest meta as low and high int32 halves.
+PTEXUTILS_API
+uint64_t topology_fingerprint(int32_t nfaces, const int32_t *nverts,
+                              const int32_t *verts);
+
+// Local change of mesh: faces removed from it and faces appended after
+// remaining ones, which keep their order
+struct PtexMeshEdit
+{
+    int32_t num_removed = 0;
+    const int32_t *removed = 0; // base face ids, ascending
+    int32_t num_added = 0;
+    const int32_t *added_nverts = 0;
+    const int32_t *added_verts = 0;
+};
+
+// Number of ptex faces of mesh after edit
+PTEXUTILS_API
+int32_t count_ptex_faces(int32_t nfaces, const int32_t *nverts,
+                         const PtexMeshEdit &edit);
+
+// Updates face infos of mesh, as computed by compute_adjacency, after
+// edit. Only faces with edges on vertex pairs used by removed or added
+// faces are recomputed, others are copied with neighbor ids remapped.
+// out gets face infos of edited mesh, kept faces keep their resolution.
+// face_remap gets new ptex face id of every old ptex face, -1 for
+// removed ones, so texels of kept faces can be carried over.
+PTEXUTILS_API
+int update_adjacency(int32_t nfaces, const int32_t *nverts, const int32_t *verts,
+                     const Ptex::FaceInfo *faces, const PtexMeshEdit &edit,
+                     Ptex::FaceInfo *out, int32_t *face_remap,
+                     Ptex::String &err_msg);
+
 PTEXUTILS_API
 bool ptex_topology_match(int32_t n, const Ptex::FaceInfo *nfaces,
                          const Ptex::FaceInfo *mfaces,
                          int32_t noffset = 0, int32_t moffset = 0);
 
+struct PtexPackInput
+{
+    const char *file = 0;
+    int first_channel = 0;
+    int num_channels = 0; // 0 - all channels from first_channel
+};
+
+// Interleaves selected channels of inputs with same topology into one
+// texture of given data type. Face is constant if it is constant in all
+// inputs, otherwise it gets resolution of non constant inputs, which must
+// be same in all of them.
+// Faces are packed on num_threads threads, 0 - all cores.
+PTEXUTILS_API
+int ptex_pack(int ninputs, const PtexPackInput *inputs,
+              const char *output_file,
+              Ptex::DataType data_type, int alpha_channel,
+              int num_threads,
+              Ptex::String &err_msg);
+
 PTEXUTILS_API
 int ptex_conform(const char* filename,
                  const char* output_filename,
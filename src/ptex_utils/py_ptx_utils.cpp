@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <vector>
 
 #include <Python.h>
 
@@ -38,23 +40,112 @@ as_fs_string(PyObject *obj){
     }
     return result;
 }
+static
+int ipow(int base, int exp)
+{
+    int result = 1;
+    while (exp)
+    {
+        if (exp & 1)
+            result *= base;
+        exp >>= 1;
+        base *= base;
+    }
+    return result;
+}
+static
+bool to_log2(int input, int8_t &outp) {
+    if (input < 2 || input > 32768)
+        return false;
+    int inp = input;
+    int8_t log2 = 0;
+    while (inp >>= 1) ++log2;
+    if (ipow(2, log2) != input)
+        return false;
+    outp = log2;
+    return true;
+}
+
+
+// Reads downsize or clampsize argument of merge: int used for all inputs
+// or sequence with value for every input. Clamp sizes are converted to log2.
+static int
+read_resize(PyObject *obj, Py_ssize_t ninputs, bool clamp,
+            int8_t &value, std::vector<int8_t> &per_input)
+{
+    auto convert = [&](PyObject *item, int8_t &out) -> bool {
+        long v = PyInt_AsLong(item);
+        if (v == -1 && PyErr_Occurred())
+            return false;
+        if (v == 0) {
+            out = 0;
+            return true;
+        }
+        if (clamp ? !to_log2(v, out) : (v < 0 || v > 15)) {
+            PyErr_SetString(PyExc_ValueError, clamp
+                            ? "Invalid clampsize. Expected power of two integer"
+                            : "Invalid downsize. Expected integer in range 1 to 15 range");
+            return false;
+        }
+        if (!clamp)
+            out = v;
+        return true;
+    };
+    if (!obj)
+        return 0;
+    if (!PySequence_Check(obj))
+        return convert(obj, value) ? 0 : -1;
+    if (PySequence_Length(obj) != ninputs) {
+        PyErr_SetString(PyExc_ValueError, "Expected value for every input");
+        return -1;
+    }
+    per_input.resize(ninputs, 0);
+    for (Py_ssize_t i = 0; i < ninputs; ++i) {
+        PyObject *item = PySequence_GetItem(obj, i);
+        if (!item)
+            return -1;
+        bool ok = convert(item, per_input[i]);
+        Py_DECREF(item);
+        if (!ok)
+            return -1;
+    }
+    return 0;
+}
 
 static PyObject*
-Py_merge_ptex(PyObject *, PyObject* args){
+Py_merge_ptex(PyObject *, PyObject* args, PyObject *kws){
     PyObject *input_list = 0, *seq = 0, *item = 0, *result = 0;
 
     char *output = 0;
+    int threads = 1;
+    int max_open_files = 0;
+    unsigned long long max_memory = 0;
+    int skip_mipmaps = 0;
+    int virtual_merge = 0;
+    PyObject *downsize = 0, *clampsize = 0;
+    int digests = 0;
 
     Py_ssize_t input_len;
     Ptex::String err_msg;
+    PtexMergeOptions options;
     int status;
 
-    if(!PyArg_ParseTuple(args, "Oet:merge_ptex", &input_list,
-                         Py_FileSystemDefaultEncoding,
-                         &output))
+    static const char *keywords[] = { "inputs", "output", "threads",
+                                      "max_open_files", "max_memory",
+                                      "skip_mipmaps", "virtual",
+                                      "downsize", "clampsize", "digests", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "Oet|iiKiiOOi:merge_ptex",
+                                    (char **) keywords,
+                                    &input_list,
+                                    Py_FileSystemDefaultEncoding, &output,
+                                    &threads, &max_open_files, &max_memory,
+                                    &skip_mipmaps, &virtual_merge,
+                                    &downsize, &clampsize, &digests))
 	return 0;
 
     std::vector<const char*> input_files;
+    std::vector<int8_t> downsizes, clamp_sizes;
+    int8_t downsize_all = 0, clamp_size_all = 0;
     std::vector<PyObject*> bytes_objects;
     std::vector<int> offsets;
 
@@ -71,6 +162,10 @@ Py_merge_ptex(PyObject *, PyObject* args){
 	goto exit;
     }
 
+    if (read_resize(downsize, input_len, false, downsize_all, downsizes)
+        || read_resize(clampsize, input_len, true, clamp_size_all, clamp_sizes))
+        goto exit;
+
     input_files.resize(input_len, 0);
     bytes_objects.resize(input_len, 0);
     offsets.resize(input_len, 0);
@@ -88,7 +183,21 @@ Py_merge_ptex(PyObject *, PyObject* args){
     }
 
     Py_BEGIN_ALLOW_THREADS;
-    status = ptex_merge((int) input_len, input_files.data(), output, offsets.data(), err_msg);
+    status = ptex_merge_options(input_files[0], options, err_msg);
+    if (!status) {
+        options.num_threads = threads;
+        options.max_open_files = max_open_files;
+        options.max_memory = max_memory;
+        options.skip_mipmaps = skip_mipmaps;
+        options.virtual_merge = virtual_merge;
+        options.downsize = downsize_all;
+        options.clamp_size = clamp_size_all;
+        options.input_downsize = downsizes.empty() ? 0 : downsizes.data();
+        options.input_clamp_size = clamp_sizes.empty() ? 0 : clamp_sizes.data();
+        options.digests = digests;
+        status = ptex_merge(options, (int) input_len, input_files.data(), output,
+                            offsets.data(), err_msg);
+    }
     Py_END_ALLOW_THREADS;
 
     if (status){
@@ -112,19 +221,213 @@ Py_merge_ptex(PyObject *, PyObject* args){
     return result;
 }
 
+// Converts sequence of paths to file system strings. Returned bytes
+// objects own the strings and should be decrefed by caller.
+static int
+read_filenames(PyObject *input_list,
+               std::vector<PyObject*> &bytes_objects,
+               std::vector<const char*> &input_files)
+{
+    PyObject *seq = PySequence_Fast(input_list, "expected sequence of filepaths");
+    if (seq == 0)
+        return -1;
+    Py_ssize_t input_len = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < input_len; ++i){
+        PyObject *item = as_fs_string(PySequence_Fast_GET_ITEM(seq, i));
+        if(!item){
+            PyErr_Format(PyExc_ValueError, "Input list element %i is not a string", (int) i);
+            Py_DECREF(seq);
+            return -1;
+        }
+        bytes_objects.push_back(item);
+        input_files.push_back(PyBytes_AsString(item));
+    }
+    Py_DECREF(seq);
+    return 0;
+}
+
+static const char* merge_plan__doc__ =
+    "merge_plan(inputs, threads=0)\n"
+    "Reads headers of textures to be merged and returns dict with offsets\n"
+    "of inputs and size and memory estimates of merge";
+
+static PyObject*
+Py_merge_plan(PyObject *, PyObject* args, PyObject *kws){
+    PyObject *input_list = 0, *offsets_list = 0, *result = 0;
+    int threads = 0;
+
+    static const char *keywords[] = { "inputs", "threads", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "O|i:merge_plan",
+                                    (char **) keywords,
+                                    &input_list, &threads))
+        return 0;
+
+    std::vector<PyObject*> bytes_objects;
+    std::vector<const char*> input_files;
+    std::vector<int> offsets;
+    PtexMergeOptions options;
+    PtexMergePlan plan;
+    Ptex::String err_msg;
+    int status = 0;
+
+    if (read_filenames(input_list, bytes_objects, input_files))
+        goto exit;
+    if (input_files.empty()) {
+        PyErr_SetString(PyExc_ValueError, "at least 1 input file required");
+        goto exit;
+    }
+    offsets.resize(input_files.size(), 0);
+
+    Py_BEGIN_ALLOW_THREADS;
+    status = ptex_merge_options(input_files[0], options, err_msg);
+    if (!status) {
+        options.num_threads = threads;
+        status = ptex_merge_plan(options, input_files.size(), input_files.data(),
+                                 offsets.data(), plan, err_msg);
+    }
+    Py_END_ALLOW_THREADS;
+
+    if (status) {
+        PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        goto exit;
+    }
+
+    offsets_list = PyList_New(offsets.size());
+    for (size_t i = 0; i < offsets.size(); ++i)
+        PyList_SetItem(offsets_list, i, PyInt_FromLong(offsets[i])); //steals item
+
+    result = Py_BuildValue("{s:N, s:i, s:L, s:L, s:L, s:L, s:L, s:i}",
+                           "offsets", offsets_list,
+                           "num_faces", plan.num_faces,
+                           "constant_faces", (long long) plan.constant_faces,
+                           "texels", (long long) plan.texels,
+                           "data_bytes", (long long) plan.data_bytes,
+                           "output_bytes", (long long) plan.output_bytes,
+                           "peak_memory", (long long) plan.peak_memory,
+                           "max_open_files", plan.max_open_files);
+  exit:
+    for (PyObject * o : bytes_objects) {
+        Py_XDECREF(o);
+    }
+    return result;
+}
+
+static const char* merge_ptex_sharded__doc__ =
+    "merge_ptex_sharded(inputs, output, max_faces=0, max_texels=0, max_bytes=0,\n"
+    "                   threads=0)\n"
+    "Merges inputs into output.N.ptx shards under given limits and writes\n"
+    "output.manifest. Returns list of (input, shard, offset)";
+
+static PyObject*
+Py_merge_ptex_sharded(PyObject *, PyObject* args, PyObject *kws){
+    PyObject *input_list = 0, *result = 0;
+    char *output = 0;
+    long long max_faces = 0, max_texels = 0, max_bytes = 0;
+    int threads = 0;
+
+    static const char *keywords[] = { "inputs", "output", "max_faces", "max_texels",
+                                      "max_bytes", "threads", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "Oet|LLLi:merge_ptex_sharded",
+                                    (char **) keywords,
+                                    &input_list,
+                                    Py_FileSystemDefaultEncoding, &output,
+                                    &max_faces, &max_texels, &max_bytes, &threads))
+        return 0;
+
+    std::vector<PyObject*> bytes_objects;
+    std::vector<const char*> input_files;
+    std::vector<int> shards, offsets;
+    PtexMergeOptions options;
+    PtexShardBudget budget;
+    Ptex::String err_msg;
+    int nshards = 0;
+    int status = 0;
+
+    if (read_filenames(input_list, bytes_objects, input_files))
+        goto exit;
+    if (input_files.empty()) {
+        PyErr_SetString(PyExc_ValueError, "at least 1 input file required");
+        goto exit;
+    }
+    shards.resize(input_files.size(), 0);
+    offsets.resize(input_files.size(), 0);
+    budget.faces = max_faces;
+    budget.texels = max_texels;
+    budget.bytes = max_bytes;
+
+    Py_BEGIN_ALLOW_THREADS;
+    status = ptex_merge_options(input_files[0], options, err_msg);
+    if (!status) {
+        options.num_threads = threads;
+        status = ptex_merge_sharded(options, budget,
+                                    input_files.size(), input_files.data(), output,
+                                    shards.data(), offsets.data(), nshards, err_msg);
+    }
+    Py_END_ALLOW_THREADS;
+
+    if (status) {
+        PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        goto exit;
+    }
+
+    result = PyList_New(input_files.size());
+    for (size_t i = 0; i < input_files.size(); ++i){
+        PyObject *item = PySequence_GetItem(input_list, i);
+        PyList_SetItem(result, i, Py_BuildValue("Nii", item, shards[i], offsets[i]));
+    }
+  exit:
+    for (PyObject * o : bytes_objects) {
+        Py_XDECREF(o);
+    }
+    PyMem_Free(output);
+    return result;
+}
+
 static PyObject*
-Py_remerge_ptex(PyObject *, PyObject* args)
+Py_compact_ptex(PyObject *, PyObject* args, PyObject *kws)
+{
+    char *input = 0, *output = 0;
+    static const char *keywords[] = { "input", "output", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "et|et:compact_ptex", (char **) keywords,
+                                    Py_FileSystemDefaultEncoding, &input,
+                                    Py_FileSystemDefaultEncoding, &output))
+	return 0;
+    Ptex::String err_msg;
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = ptex_compact(input, output, err_msg);
+    Py_END_ALLOW_THREADS
+    PyMem_Free(input);
+    PyMem_Free(output);
+    if (status){
+	PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        return 0;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Py_remerge_ptex(PyObject *, PyObject* args, PyObject *kws)
 {
     char *filename = 0, *searchdir = 0;
-    if(!PyArg_ParseTuple(args, "etet:remerge_ptex",
-                         Py_FileSystemDefaultEncoding, &filename,
-                         Py_FileSystemDefaultEncoding, &searchdir))
+    PtexRemergeOptions opts;
+    int incremental = 0;
+    int max_edit_mb = 0;
+    static const char *keywords[] = { "input", "searchdir", "threads", "incremental",
+                                      "max_edits", "max_edit_mb", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "etet|iiii:remerge_ptex", (char **) keywords,
+                                    Py_FileSystemDefaultEncoding, &filename,
+                                    Py_FileSystemDefaultEncoding, &searchdir,
+                                    &opts.num_threads, &incremental,
+                                    &opts.max_edits, &max_edit_mb))
 	return 0;
+    opts.incremental = incremental;
+    opts.max_edit_bytes = size_t(std::max(max_edit_mb, 0)) << 20;
 
     Ptex::String err_msg;
     int status = 0;
     Py_BEGIN_ALLOW_THREADS;
-    status = ptex_remerge(filename, searchdir, err_msg);
+    status = ptex_remerge(opts, filename, searchdir, err_msg);
     Py_END_ALLOW_THREADS;
     PyMem_Free(filename);
     PyMem_Free(searchdir);
@@ -157,6 +460,31 @@ Py_reverse_ptex(PyObject *, PyObject* args){
     Py_RETURN_NONE;
 }
 
+static PyObject*
+Py_split_ptex(PyObject *, PyObject* args, PyObject *kws){
+    char *input = 0;
+    char *output_dir = 0;
+    int threads = 0;
+    Ptex::String err_msg;
+    int status;
+    static const char *keywords[] = { "input", "output_dir", "threads", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "etet|i:split_ptex", (char **) keywords,
+                                    Py_FileSystemDefaultEncoding, &input,
+                                    Py_FileSystemDefaultEncoding, &output_dir,
+                                    &threads))
+	return 0;
+    Py_BEGIN_ALLOW_THREADS
+    status = ptex_split(input, output_dir, threads, err_msg);
+    Py_END_ALLOW_THREADS
+    PyMem_Free(input);
+    PyMem_Free(output_dir);
+    if (status){
+	PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        return 0;
+    }
+    Py_RETURN_NONE;
+}
+
 template <typename Conv, typename Vec, typename T>
 static
 int read_sequence(PyObject *seq, Conv conv, Vec & vec, T) {
@@ -186,17 +514,23 @@ Py_make_constant(PyObject *, PyObject* args, PyObject *kws) {
 
     int alphachan = -1;
 
+    int threads = 0;
+
+    char *adjacency_cache = 0;
+
     PyObject *data = 0, *nverts = 0, *verts = 0, *pos = 0;
 
     PyObject *sdata = 0, *snverts = 0, *sverts = 0, *spos = 0;
 
     static const char *keywords[] = { "filename", "format", "data", "nverts", "verts", "pos",
-                                      "alphachannel", NULL};
-    if(!PyArg_ParseTupleAndKeywords(args, kws, "etetOOOO|i:make_constant",
+                                      "alphachannel", "threads", "adjacency_cache", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "etetOOOO|iiet:make_constant",
                                     (char **) keywords,
                                     Py_FileSystemDefaultEncoding, &output,
                                     Py_FileSystemDefaultEncoding, &cformat,
-                                    &data, &nverts, &verts, &pos, &alphachan))
+                                    &data, &nverts, &verts, &pos, &alphachan,
+                                    &threads,
+                                    Py_FileSystemDefaultEncoding, &adjacency_cache))
         return 0;
 
     obj_mesh mesh;
@@ -307,7 +641,7 @@ Py_make_constant(PyObject *, PyObject* args, PyObject *kws) {
     err = ptex_utils::make_constant(output, dt, nchans, alphachan,
                                     ptx_data,
                                     mesh.nverts.size(), mesh.nverts.data(), mesh.verts.data(),
-                                    mesh.pos.data(), err_msg);
+                                    mesh.pos.data(), threads, adjacency_cache, err_msg);
     Py_END_ALLOW_THREADS;
     if (err) {
         PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
@@ -315,6 +649,7 @@ Py_make_constant(PyObject *, PyObject* args, PyObject *kws) {
   exit:
     PyMem_Free(output);
     PyMem_Free(cformat);
+    PyMem_Free(adjacency_cache);
     Py_XDECREF(sdata);
     Py_XDECREF(snverts);
     Py_XDECREF(sverts);
@@ -367,33 +702,6 @@ Py_ptex_info(PyObject *, PyObject *args) {
                          "texels", (unsigned long long) info.texels);
 }
 
-static
-int ipow(int base, int exp)
-{
-    int result = 1;
-    while (exp)
-    {
-        if (exp & 1)
-            result *= base;
-        exp >>= 1;
-        base *= base;
-    }
-    return result;
-}
-static
-bool to_log2(int input, int8_t &outp) {
-    if (input < 2 || input > 32768)
-        return false;
-    int inp = input;
-    int8_t log2 = 0;
-    while (inp >>= 1) ++log2;
-    if (ipow(2, log2) != input)
-        return false;
-    outp = log2;
-    return true;
-}
-
-
 static PyObject*
 Py_ptex_conform(PyObject *, PyObject *args, PyObject *kws) {
     char* input = 0;
@@ -477,15 +785,408 @@ Py_ptex_conform(PyObject *, PyObject *args, PyObject *kws) {
 }
 
 
+static const char* patch_ptex__doc__ =
+    "patch_ptex(input, faces, datatype=None, channels=0)\n"
+    "Replaces faces of input in place, appending only them as edit. Face is\n"
+    "(face_id, (ulog2, vlog2), data) tuple, data is buffer of pixels in\n"
+    "datatype with channels channels, file format if not set. Data of one\n"
+    "pixel makes constant face.";
+
+static PyObject*
+Py_patch_ptex(PyObject *, PyObject *args, PyObject *kws) {
+    char *input = 0;
+    PyObject *face_list = 0;
+    char *data_type = 0;
+    int channels = 0;
+    PyObject *result = 0;
+
+    static const char *keywords[] = { "input", "faces", "datatype", "channels", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "etO|zi:patch_ptex",
+                                    (char **) keywords,
+                                    Py_FileSystemDefaultEncoding, &input,
+                                    &face_list, &data_type, &channels))
+        return 0;
+
+    std::vector<Py_buffer> buffers;
+    std::vector<PtexPatchFace> faces;
+    PtexInfo info;
+    Ptex::DataType dt;
+    Ptex::String err_msg;
+    int status = 0;
+    size_t pixel_size;
+    Py_ssize_t nfaces;
+
+    Py_BEGIN_ALLOW_THREADS;
+    status = ptex_info(input, info, err_msg);
+    Py_END_ALLOW_THREADS;
+    if (status) {
+        PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        goto exit;
+    }
+    dt = info.data_type;
+    if (data_type) {
+        if (strcmp(data_type, "uint8") == 0)
+            dt = Ptex::dt_uint8;
+        else if (strcmp(data_type, "uint16") == 0)
+            dt = Ptex::dt_uint16;
+        else if (strcmp(data_type, "half") == 0)
+            dt = Ptex::dt_half;
+        else if (strcmp(data_type, "float") == 0)
+            dt = Ptex::dt_float;
+        else {
+            PyErr_SetString(PyExc_ValueError, "Invalid data type. Expected: "
+                            "uint8, uint16, half or float");
+            goto exit;
+        }
+    }
+    if (channels <= 0)
+        channels = info.num_channels;
+    pixel_size = Ptex::DataSize(dt) * channels;
+
+    if (!PySequence_Check(face_list)) {
+        PyErr_SetString(PyExc_ValueError, "faces should be sequence of face tuples");
+        goto exit;
+    }
+    nfaces = PySequence_Length(face_list);
+    faces.resize(nfaces);
+    buffers.reserve(nfaces);
+    for (Py_ssize_t i = 0; i < nfaces; ++i) {
+        PyObject *item = PySequence_GetItem(face_list, i);
+        if (!item)
+            goto exit;
+        PtexPatchFace &face = faces[i];
+        int ulog2 = 0, vlog2 = 0;
+        Py_buffer data;
+        int ok = PyArg_ParseTuple(item, "i(ii)s*", &face.face_id, &ulog2, &vlog2, &data);
+        Py_DECREF(item);
+        if (!ok)
+            goto exit;
+        buffers.push_back(data);
+        face.res = Ptex::Res(ulog2, vlog2);
+        face.constant = (size_t) data.len == pixel_size;
+        face.data = data.buf;
+        if (!face.constant && (ulog2 < 0 || vlog2 < 0 || ulog2 > 15 || vlog2 > 15 ||
+                               (size_t) data.len != face.res.size() * pixel_size)) {
+            PyErr_Format(PyExc_ValueError, "Data size of face %d does not match resolution",
+                         face.face_id);
+            goto exit;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    status = ptex_patch(input, nfaces, faces.data(), dt, channels, err_msg);
+    Py_END_ALLOW_THREADS;
+    if (status) {
+        PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        goto exit;
+    }
+    Py_INCREF(Py_None);
+    result = Py_None;
+  exit:
+    for (Py_buffer &b : buffers)
+        PyBuffer_Release(&b);
+    PyMem_Free(input);
+    return result;
+}
+
+static const char* pack_ptex__doc__ =
+    "pack_ptex(inputs, output, datatype=None, alphachannel=-1, threads=0)\n"
+    "Interleaves channels of same topology textures into output. Input is\n"
+    "path or (path, first_channel, num_channels) tuple, 0 channels take all\n"
+    "remaining. Widest input data type is used if datatype is not set.";
+
+static PyObject*
+Py_pack_ptex(PyObject *, PyObject *args, PyObject *kws) {
+    PyObject *input_list = 0;
+    char *output = 0;
+    char *data_type = 0;
+    int alphachan = -1;
+    int threads = 0;
+    PyObject *result = 0;
+
+    static const char *keywords[] = { "inputs", "output", "datatype",
+                                      "alphachannel", "threads", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "Oet|zii:pack_ptex",
+                                    (char **) keywords,
+                                    &input_list,
+                                    Py_FileSystemDefaultEncoding, &output,
+                                    &data_type, &alphachan, &threads))
+        return 0;
+
+    std::vector<PyObject*> bytes_objects;
+    std::vector<PtexPackInput> inputs;
+    Ptex::DataType dt = Ptex::dt_uint8;
+    Ptex::String err_msg;
+    int status = 0;
+    Py_ssize_t ninputs;
+
+    if (!PySequence_Check(input_list)) {
+        PyErr_SetString(PyExc_ValueError, "first argument should be sequence of inputs");
+        goto exit;
+    }
+    ninputs = PySequence_Length(input_list);
+    if (ninputs < 1) {
+        PyErr_SetString(PyExc_ValueError, "at least 1 input file required");
+        goto exit;
+    }
+    inputs.resize(ninputs);
+    for (Py_ssize_t i = 0; i < ninputs; ++i) {
+        PyObject *item = PySequence_GetItem(input_list, i);
+        if (!item)
+            goto exit;
+        PyObject *path = item;
+        if (PyTuple_Check(item) && !PyArg_ParseTuple(item, "O|ii", &path,
+                                                     &inputs[i].first_channel,
+                                                     &inputs[i].num_channels)) {
+            Py_DECREF(item);
+            goto exit;
+        }
+        PyObject *bytes = as_fs_string(path);
+        Py_DECREF(item);
+        if (!bytes)
+            goto exit;
+        bytes_objects.push_back(bytes);
+        inputs[i].file = PyBytes_AsString(bytes);
+    }
+
+    if (data_type) {
+        if (strcmp(data_type, "uint8") == 0)
+            dt = Ptex::dt_uint8;
+        else if (strcmp(data_type, "uint16") == 0)
+            dt = Ptex::dt_uint16;
+        else if (strcmp(data_type, "half") == 0)
+            dt = Ptex::dt_half;
+        else if (strcmp(data_type, "float") == 0)
+            dt = Ptex::dt_float;
+        else {
+            PyErr_SetString(PyExc_ValueError, "Invalid data type. Expected: "
+                            "uint8, uint16, half or float");
+            goto exit;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (Py_ssize_t i = 0; !data_type && !status && i < ninputs; ++i) {
+        PtexInfo info;
+        status = ptex_info(inputs[i].file, info, err_msg);
+        dt = std::max(dt, info.data_type);
+    }
+    if (!status)
+        status = ptex_pack(ninputs, inputs.data(), output, dt, alphachan, threads, err_msg);
+    Py_END_ALLOW_THREADS;
+
+    if (status) {
+        PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        goto exit;
+    }
+    Py_INCREF(Py_None);
+    result = Py_None;
+  exit:
+    for (PyObject * o : bytes_objects) {
+        Py_XDECREF(o);
+    }
+    PyMem_Free(output);
+    return result;
+}
+
+
+// MergedIndex type wrapping PtexMergedIndex
+
+typedef struct {
+    PyObject_HEAD
+    PtexMergedIndex *index;
+} PyMergedIndex;
+
+static PyObject *array_type = 0;
+
+// array('i') holding n values
+static PyObject*
+int32_array(const int32_t *values, Py_ssize_t n) {
+    PyObject *arr = PyObject_CallFunction(array_type, (char *) "s", "i");
+    if (!arr)
+        return 0;
+    PyObject *r = PyObject_CallMethod(arr, (char *) "fromstring", (char *) "s#",
+                                      (const char*) values, n * sizeof(int32_t));
+    if (!r) {
+        Py_DECREF(arr);
+        return 0;
+    }
+    Py_DECREF(r);
+    return arr;
+}
+
+// Face ids from 4 byte integer buffer or any sequence of ints
+static int
+read_face_ids(PyObject *obj, std::vector<int32_t> &ids) {
+    if (PyObject_CheckBuffer(obj)) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(obj, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) == 0) {
+            const char *f = view.format ? view.format : "B";
+            if (*f == '@' || *f == '=')
+                ++f;
+            bool int32 = view.itemsize == 4 && (*f == 'i' || *f == 'l') && !f[1];
+            if (int32) {
+                const int32_t *data = (const int32_t*) view.buf;
+                ids.assign(data, data + view.len / 4);
+            }
+            PyBuffer_Release(&view);
+            if (int32)
+                return 0;
+        }
+        PyErr_Clear();
+    }
+    PyObject *seq = PySequence_Fast(obj, "face ids should be int32 buffer or sequence");
+    if (!seq)
+        return -1;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    ids.resize(n);
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        long id = PyInt_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (id == -1 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return -1;
+        }
+        ids[i] = id;
+    }
+    Py_DECREF(seq);
+    return 0;
+}
+
+static void
+MergedIndex_dealloc(PyMergedIndex *self) {
+    delete self->index;
+    Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+static int
+MergedIndex_init(PyMergedIndex *self, PyObject *args, PyObject *kws) {
+    char *filename = 0;
+    static const char *keywords[] = { "input", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kws, "et:MergedIndex", (char **) keywords,
+                                    Py_FileSystemDefaultEncoding, &filename))
+        return -1;
+    PtexMergedIndex *index = new PtexMergedIndex;
+    Ptex::String err_msg;
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = index->load(filename, err_msg);
+    Py_END_ALLOW_THREADS
+    PyMem_Free(filename);
+    if (status) {
+        delete index;
+        PyErr_SetString(PyExc_RuntimeError, err_msg.c_str());
+        return -1;
+    }
+    delete self->index;
+    self->index = index;
+    return 0;
+}
+
+static PyMergedIndex*
+loaded_index(PyObject *self) {
+    PyMergedIndex *index = (PyMergedIndex*) self;
+    if (!index->index) {
+        PyErr_SetString(PyExc_RuntimeError, "MergedIndex is not loaded");
+        return 0;
+    }
+    return index;
+}
+
+static PyObject*
+MergedIndex_lookup(PyObject *self, PyObject *face_ids) {
+    PyMergedIndex *index = loaded_index(self);
+    if (!index)
+        return 0;
+    std::vector<int32_t> ids;
+    if (read_face_ids(face_ids, ids))
+        return 0;
+    std::vector<int32_t> sources(ids.size()), local_ids(ids.size()), mesh_offsets(ids.size());
+    Py_BEGIN_ALLOW_THREADS
+    index->index->lookup(ids.size(), ids.data(), sources.data(), local_ids.data(),
+                         mesh_offsets.data());
+    Py_END_ALLOW_THREADS
+    PyObject *result = PyTuple_New(3);
+    if (!result)
+        return 0;
+    PyObject *arrays[3] = { int32_array(sources.data(), ids.size()),
+                            int32_array(local_ids.data(), ids.size()),
+                            int32_array(mesh_offsets.data(), ids.size()) };
+    for (int i = 0; i < 3; ++i) {
+        if (!arrays[i]) {
+            for (int j = i + 1; j < 3; ++j)
+                Py_XDECREF(arrays[j]);
+            Py_DECREF(result);
+            return 0;
+        }
+        PyTuple_SET_ITEM(result, i, arrays[i]); // steals reference
+    }
+    return result;
+}
+
+static PyObject*
+MergedIndex_sources(PyObject *self, PyObject *) {
+    PyMergedIndex *index = loaded_index(self);
+    if (!index)
+        return 0;
+    const int n = index->index->num_sources();
+    PyObject *result = PyList_New(n);
+    if (!result)
+        return 0;
+    for (int k = 0; k < n; ++k) {
+        PyObject *item = Py_BuildValue("sii", index->index->source(k),
+                                       index->index->offset(k),
+                                       index->index->mesh_offset(k));
+        if (!item) {
+            Py_DECREF(result);
+            return 0;
+        }
+        PyList_SET_ITEM(result, k, item); // steals reference
+    }
+    return result;
+}
+
+static PyMethodDef MergedIndex_methods[] = {
+    { "lookup", MergedIndex_lookup, METH_O,
+      "lookup(face_ids)\n"
+      "Takes int32 buffer or sequence of merged face ids and returns\n"
+      "array('i') of source indices, face ids in sources and mesh offsets\n"
+      "of sources, -1 for ids out of range" },
+    { "sources", MergedIndex_sources, METH_NOARGS,
+      "sources()\n"
+      "Returns list of (file, offset, mesh_offset) of sources" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject MergedIndexType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "cptexutils.MergedIndex",            /* tp_name */
+    sizeof(PyMergedIndex),               /* tp_basicsize */
+};
+
+
 static PyMethodDef ptexutils_methods [] = {
-    { "merge_ptex", Py_merge_ptex, METH_VARARGS, "merge ptex files"},
-    { "remerge_ptex", Py_remerge_ptex, METH_VARARGS, "Update merged ptex"},
+    { "merge_ptex", (PyCFunction) Py_merge_ptex, METH_VARARGS | METH_KEYWORDS,
+      "merge ptex files"},
+    { "merge_plan", (PyCFunction) Py_merge_plan, METH_VARARGS | METH_KEYWORDS,
+      merge_plan__doc__},
+    { "merge_ptex_sharded", (PyCFunction) Py_merge_ptex_sharded,
+      METH_VARARGS | METH_KEYWORDS, merge_ptex_sharded__doc__},
+    { "remerge_ptex", (PyCFunction) Py_remerge_ptex, METH_VARARGS | METH_KEYWORDS,
+      "Update merged ptex"},
+    { "compact_ptex", (PyCFunction) Py_compact_ptex, METH_VARARGS | METH_KEYWORDS,
+      "fold edits of ptex file"},
+    { "split_ptex", (PyCFunction) Py_split_ptex, METH_VARARGS | METH_KEYWORDS,
+      "write sources of merged ptex file to output_dir"},
     { "reverse_ptex", Py_reverse_ptex, METH_VARARGS, "reverse faces in ptex file"},
     { "make_constant", (PyCFunction) Py_make_constant, METH_VARARGS | METH_KEYWORDS,
       "create constant ptex file"},
     { "ptex_info", Py_ptex_info, METH_VARARGS,ptex_info__doc__}, // "Get information about ptex file"},
     { "ptex_conform", (PyCFunction) Py_ptex_conform, METH_VARARGS | METH_KEYWORDS,
       "conform ptex datatype and sizes" },
+    { "pack_ptex", (PyCFunction) Py_pack_ptex, METH_VARARGS | METH_KEYWORDS,
+      pack_ptex__doc__},
+    { "patch_ptex", (PyCFunction) Py_patch_ptex, METH_VARARGS | METH_KEYWORDS,
+      patch_ptex__doc__},
     { NULL, NULL, 0, NULL }
 };
 
@@ -506,5 +1207,25 @@ initcptexutils(void){
    m = Py_InitModule3("cptexutils", ptexutils_methods, "");
    if (m == NULL)
        return;
+
+   PyObject *array_module = PyImport_ImportModule("array");
+   if (array_module == NULL)
+       return;
+   array_type = PyObject_GetAttrString(array_module, "array");
+   Py_DECREF(array_module);
+   if (array_type == NULL)
+       return;
+
+   MergedIndexType.tp_dealloc = (destructor) MergedIndex_dealloc;
+   MergedIndexType.tp_flags = Py_TPFLAGS_DEFAULT;
+   MergedIndexType.tp_doc = "MergedIndex(input)\n"
+       "Maps face ids of merged ptex file back to its sources";
+   MergedIndexType.tp_methods = MergedIndex_methods;
+   MergedIndexType.tp_init = (initproc) MergedIndex_init;
+   MergedIndexType.tp_new = PyType_GenericNew;
+   if (PyType_Ready(&MergedIndexType) < 0)
+       return;
+   Py_INCREF(&MergedIndexType);
+   PyModule_AddObject(m, "MergedIndex", (PyObject*) &MergedIndexType);
 }
 }
@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "ptexutils.hpp"
+#include "digest.hpp"
+#include "helpers.hpp"
+#include "topology.hpp"
+
+namespace fs = boost::filesystem;
+namespace sys = boost::system;
+
+uint64_t ptex_utils::topology_fingerprint(int32_t nfaces, const int32_t *nverts,
+                                          const int32_t *verts)
+{
+    int64_t nfverts = 0;
+    for (int32_t i = 0; i < nfaces; ++i)
+        nfverts += nverts[i];
+    Digest digest;
+    digest.update(&nfaces, sizeof(nfaces));
+    digest.update(nverts, nfaces * sizeof(int32_t));
+    digest.update(verts, nfverts * sizeof(int32_t));
+    // 0 stands for unknown topology in meta
+    uint64_t value = digest.value();
+    return value ? value : 1;
+}
+
+uint64_t texture_topology(PtexTexture *ptex)
+{
+    MetaPtr meta(ptex->getMetaData());
+    std::vector<uint64_t> stored;
+    if (read_uint64_meta(meta.get(), "PtexTopologyDigest", stored) && stored.size() == 1)
+        return stored[0];
+
+    const int32_t *nverts = 0, *verts = 0;
+    int nfaces = 0, nfverts = 0;
+    meta->getValue("PtexFaceVertCounts", nverts, nfaces);
+    meta->getValue("PtexFaceVertIndices", verts, nfverts);
+    if (!nverts || !verts)
+        return 0;
+    int64_t count = 0;
+    for (int i = 0; i < nfaces; ++i)
+        count += nverts[i];
+    if (count != nfverts)
+        return 0;
+    return ptex_utils::topology_fingerprint(nfaces, nverts, verts);
+}
+
+void write_topology(PtexWriter *writer, int32_t nfaces,
+                    const int32_t *nverts, const int32_t *verts)
+{
+    std::vector<uint64_t> value(1, ptex_utils::topology_fingerprint(nfaces, nverts, verts));
+    write_uint64_meta(writer, "PtexTopologyDigest", value);
+}
+
+namespace {
+
+// Cache file holds header and face infos as computed, it is read only
+// on machines with same FaceInfo layout
+struct CacheHeader {
+    char magic[8];
+    uint64_t fingerprint;
+    int32_t num_faces;
+    int32_t num_ptex_faces;
+    int32_t face_info_size;
+    int32_t reserved;
+};
+
+const char cache_magic[8] = { 'P', 't', 'x', 'A', 'd', 'j', '0', '1' };
+
+struct File {
+    FILE *f = 0;
+    ~File() {
+        if (f)
+            std::fclose(f);
+    }
+};
+
+fs::path cache_path(const char *dir, uint64_t fingerprint)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.adj", (unsigned long long) fingerprint);
+    return fs::path(dir) / name;
+}
+
+bool read_cache(const fs::path &path, const CacheHeader &expected,
+                Ptex::FaceInfo *out)
+{
+    File file;
+    file.f = std::fopen(path.string().c_str(), "rb");
+    if (!file.f)
+        return false;
+    CacheHeader header;
+    if (std::fread(&header, sizeof(header), 1, file.f) != 1 ||
+        std::memcmp(&header, &expected, sizeof(header)) != 0)
+        return false;
+    const size_t n = expected.num_ptex_faces;
+    return std::fread(out, sizeof(Ptex::FaceInfo), n, file.f) == n;
+}
+
+// Cache is written to temporary file first and renamed over cache path,
+// so concurrent builds of same mesh never see partial file
+void write_cache(const fs::path &path, const CacheHeader &header,
+                 const Ptex::FaceInfo *faces)
+{
+    sys::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    fs::path tmp = path.parent_path() / fs::unique_path("%%%%-%%%%-%%%%.tmp", ec);
+    if (ec)
+        return;
+    bool written;
+    {
+        File file;
+        file.f = std::fopen(tmp.string().c_str(), "wb");
+        if (!file.f)
+            return;
+        const size_t n = header.num_ptex_faces;
+        written = std::fwrite(&header, sizeof(header), 1, file.f) == 1 &&
+            std::fwrite(faces, sizeof(Ptex::FaceInfo), n, file.f) == n;
+        written = std::fclose(file.f) == 0 && written;
+        file.f = 0;
+    }
+    if (written)
+        fs::rename(tmp, path, ec);
+    if (!written || ec)
+        fs::remove(tmp, ec);
+}
+
+}
+
+void ptex_utils::compute_adjacency(int32_t nfaces, int32_t *nverts, int32_t *verts,
+                                   Ptex::FaceInfo *out, int num_threads,
+                                   const char *adjacency_cache)
+{
+    if (!adjacency_cache || !adjacency_cache[0]) {
+        compute_adjacency(nfaces, nverts, verts, out, num_threads);
+        return;
+    }
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cache_magic, sizeof(header.magic));
+    header.fingerprint = topology_fingerprint(nfaces, nverts, verts);
+    header.num_faces = nfaces;
+    header.num_ptex_faces = count_ptex_faces(nfaces, nverts);
+    header.face_info_size = sizeof(Ptex::FaceInfo);
+
+    fs::path path = cache_path(adjacency_cache, header.fingerprint);
+    if (read_cache(path, header, out))
+        return;
+    compute_adjacency(nfaces, nverts, verts, out, num_threads);
+    write_cache(path, header, out);
+}
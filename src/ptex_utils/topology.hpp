@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <Ptexture.h>
+
+// Topology fingerprint of texture from its PtexTopologyDigest meta, or
+// computed from its mesh meta if that is missing. 0 if texture has
+// neither.
+uint64_t texture_topology(PtexTexture *ptex);
+
+// Writes PtexTopologyDigest meta of mesh
+void write_topology(PtexWriter *writer, int32_t nfaces,
+                    const int32_t *nverts, const int32_t *verts);